@@ -41,6 +41,14 @@ w_ttbr0_el1(uint64 x)
   asm volatile("msr ttbr0_el1, %0" : : "r" (x) );
 }
 
+static inline uint64
+r_id_aa64mmfr0_el1()
+{
+  uint64 x;
+  asm volatile("mrs %0, id_aa64mmfr0_el1" : "=r" (x) );
+  return x;
+}
+
 static inline uint64
 r_ttbr0_el1()
 {
@@ -63,6 +71,21 @@ r_ttbr1_el1()
   return x;
 }
 
+// exception syndrome register
+#define ESR_EC(esr)     (((esr) >> 26) & 0x3f)  // exception class
+#define ESR_ISS(esr)    ((esr) & 0x1ffffff)     // instruction specific syndrome
+
+#define EC_FP           0x07  // FP/SIMD access trapped by CPACR_EL1
+#define EC_SVC64        0x15  // svc in aarch64
+#define EC_IABT_LOW     0x20  // instruction abort from a lower EL
+#define EC_DABT_LOW     0x24  // data abort from a lower EL
+#define EC_DABT_CUR     0x25  // data abort from the current EL
+
+#define ISS_WNR         (1 << 6)    // data abort caused by a write
+#define ISS_FSC(iss)    ((iss) & 0x3f)  // fault status code
+#define FSC_TRANS(fsc)  (((fsc) & 0x3c) == 0x04)  // translation fault
+#define FSC_PERM(fsc)   (((fsc) & 0x3c) == 0x0c)  // permission fault
+
 static inline uint64
 r_esr_el1()
 {
@@ -122,6 +145,20 @@ w_cntv_tval_el0(uint64 x)
   asm volatile("msr cntv_tval_el0, %0" : : "r" (x) );
 }
 
+static inline uint64
+r_cntv_cval_el0()
+{
+  uint64 x;
+  asm volatile("mrs %0, cntv_cval_el0" : "=r" (x) );
+  return x;
+}
+
+static inline void
+w_cntv_cval_el0(uint64 x)
+{
+  asm volatile("msr cntv_cval_el0, %0" : : "r" (x) );
+}
+
 static inline uint64
 r_cntvct_el0()
 {
@@ -138,6 +175,25 @@ r_cntfrq_el0()
   return x;
 }
 
+// architectural feature access control
+#define CPACR_FPEN(n)   (((n) & 3) << 20)
+#define CPACR_FPEN_EL0  CPACR_FPEN(1)   // FP/SIMD at EL0 traps, not at EL1
+#define CPACR_FPEN_ALL  CPACR_FPEN(3)   // FP/SIMD does not trap
+
+static inline uint64
+r_cpacr_el1()
+{
+  uint64 x;
+  asm volatile("mrs %0, cpacr_el1" : "=r" (x) );
+  return x;
+}
+
+static inline void
+w_cpacr_el1(uint64 x)
+{
+  asm volatile("msr cpacr_el1, %0" : : "r" (x) );
+}
+
 // enable device interrupts(irq)
 static inline void
 intr_on()
@@ -190,6 +246,14 @@ isb()
   asm volatile("isb");
 }
 
+// wait for an interrupt; returns when one is pending,
+// even if interrupts are disabled.
+static inline void
+wfi()
+{
+  asm volatile("wfi" ::: "memory");
+}
+
 #define dsb(ty)   asm volatile("dsb " #ty)
 
 // flush the TLB.
@@ -202,6 +266,25 @@ flush_tlb()
   isb();
 }
 
+// flush the TLB entries tagged with one ASID.
+static inline void
+flush_tlb_asid(uint64 asid)
+{
+  asm volatile("dsb ishst");
+  asm volatile("tlbi aside1is, %0" : : "r" (asid << 48));
+  asm volatile("dsb ish");
+  isb();
+}
+
+// invalidate the last-level TLB entries for the page at va
+// tagged with asid, on all CPUs. The caller brackets a batch of
+// these with dsb ishst before and dsb ish; isb after.
+static inline void
+tlbi_vale1is(uint64 asid, uint64 va)
+{
+  asm volatile("tlbi vale1is, %0" : : "r" ((asid << 48) | ((va >> 12) & 0xfffffffffffUL)));
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -218,6 +301,7 @@ typedef uint64 *pagetable_t; // 512 PTEs
 
 #define PTE_VALID 1  // level 0,1,2 descriptor: valid
 #define PTE_TABLE 2  // level 0,1,2 descriptor: table
+                     // (a valid level 1,2 descriptor without it is a block)
 #define PTE_V     3  // level 3 descriptor: valid
 // PTE_AF(Access Flag)
 //
@@ -241,6 +325,11 @@ typedef uint64 *pagetable_t; // 512 PTEs
 
 #define PTE_USER  (PTE_U|PTE_nG)
 
+// bits 55-58 are reserved for software use and ignored by the MMU.
+#define PTE_SW(n)   (1UL << (55 + (n)))
+#define PTE_COW     PTE_SW(0)   // copy-on-write: shared read-only until written
+#define PTE_DIRTY   PTE_SW(1)   // MAP_SHARED file page written since msync()
+
 // Shareable attribute
 #define PTE_SH(sh)    (((sh) & 3) << 8)
 #define PTE_SH_OUTER  PTE_SH(2)   // outer sharable
@@ -266,7 +355,7 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PA2PTE(pa)  ((uint64)(pa) & 0xfffffffff000)
 #define PTE2PA(pte) ((uint64)(pte) & 0xfffffffff000)
 
-#define PTE_FLAGS(pte)  ((pte) & (0x600000000003ff))
+#define PTE_FLAGS(pte)  ((pte) & (0x7e0000000000fff))
 
 //
 //  39bit(=512GB) Virtual Address
@@ -283,6 +372,10 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PXSHIFT(level)  (39-(level)*9)
 #define PX(level, va) ((((uint64)(va)) >> PXSHIFT(level)) & PXMASK)
 
+// bytes mapped by one entry of a level: 1GB block at level 1,
+// 2MB block at level 2, page at level 3.
+#define BLKSIZE(level)  (1UL << PXSHIFT(level))
+
 // translation control register
 #define TCR_T0SZ(n)   ((n) & 0x3f)
 #define TCR_IRGN0(n)  (((n) & 0x3) << 8)
@@ -138,8 +138,11 @@ consoleintr(int c)
   acquire(&cons.lock);
 
   switch(c){
-  case C('P'):  // Print process list.
+  case C('P'):  // Print process list and memory statistics.
     procdump();
+    kmemdump();
+    kmallocdump();
+    kvmdump();
     break;
   case C('U'):  // Kill line.
     while(cons.e != cons.w &&
@@ -6,3 +6,11 @@ struct rtcdate {
   uint month;
   uint year;
 };
+
+struct timespec {
+  uint64 tv_sec;
+  uint64 tv_nsec;
+};
+
+// clock_gettime() clocks
+#define CLOCK_MONOTONIC 1   // time since boot
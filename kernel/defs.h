@@ -2,6 +2,8 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmcache;
+struct membank;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -9,6 +11,7 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct trapframe;
+struct vma;
 enum pinmode;
 
 void cpu_sync_cache(void *va, uint64 sz);
@@ -27,7 +30,11 @@ void            consoleintr(int);
 void            consputc(int);
 
 // exec.c
-int             exec(char*, char**);
+int             exec(struct proc*, char*, char**);
+
+// fdt.c
+int             fdt_memory(void *, struct membank *, int);
+int             fdt_reserved(void *, struct membank *, int);
 
 // file.c
 struct file*    filealloc(void);
@@ -38,6 +45,13 @@ int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
 
+// fpsimd.c
+void            fpinithart(void);
+void            fptrap(struct proc*);
+void            fpswitch(struct proc*);
+void            fpflush(struct proc*);
+void            fpreset(struct proc*);
+
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
@@ -65,9 +79,27 @@ void            ramdiskrw(struct buf*, int);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_zeroed(void);
 void            kfree(void *);
+void*           kalloc_order(int);
+void            kfree_order(void *, int);
 void            kinit1(void *, void *);
 void            kinit2(void *, void *);
+void            kincref(void *);
+void            ksplit(void *, int);
+int             kzerofill(void);
+void            kmemdump(void);
+int             krefcnt(void *);
+void            meminit(uint64);
+extern uint64   phystop;
+
+// kmalloc.c
+void            kmallocinit(void);
+struct kmcache* kmcache_create(char*, uint);
+void*           kmcache_alloc(struct kmcache*);
+void*           kmalloc(uint);
+void            kmfree(void*);
+void            kmallocdump(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -75,7 +107,16 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// mmap.c
+uint64          mmap(uint64, uint64, int, int, int, uint64);
+int             munmap(uint64, uint64);
+int             mprotect(uint64, uint64, int);
+int             msync(uint64, uint64, int);
+int             mmapcopy(struct proc*, struct proc*);
+void            mmapfree(struct proc*);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -89,6 +130,8 @@ void            printfinit(void);
 // proc.c
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, int*);
+int             schedctl(int, uint64);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 int             kill(int);
@@ -102,10 +145,13 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeup_one(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            vmadup(struct vma *, struct vma *);
+void            vmaput(struct vma *);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -124,10 +170,13 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
-// string.c
+// mem.S
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
+
+// string.c
+void            memtest(void);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
@@ -142,10 +191,7 @@ int             fetchaddr(uint64, uint64*);
 void            syscall();
 
 // trap.c
-extern uint     ticks;
-void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
 void            usertrapret(struct trapframe *);
 
 // uart.c
@@ -159,12 +205,17 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, uint64);
+void            kvmdump(void);
 int             mappages(pagetable_t, uint64, uint64, uint64, uint64);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopy(pagetable_t, pagetable_t, uint64, uint64, int);
+void            uvmprotect(pagetable_t, uint64, uint64, int);
+uint64          uvmclean(pagetable_t, uint64);
+int             uvmfault(struct proc *, uint64, int);
+void            uvmprefault(struct proc *, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
@@ -174,6 +225,7 @@ int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 void            switchuvm(struct proc *);
 void            switchkvm(void);
+void            asidfree(uint64);
 
 // gicv2.c
 void            gicv2init(void);
@@ -181,10 +233,22 @@ void            gicv2inithart(void);
 uint32          gic_iar(void);
 int             gic_iar_irq(uint32);
 void            gic_eoi(uint32);
+void            gic_send_sgi(int, uint32);
 
 // timer.c
 void            timerinit(void);
 void            timerintr(void);
+uint            timerticks(void);
+int             timersettick(uint);
+uint64          timerclkns(uint64);
+uint64          timerns(void);
+uint64          timerafter(uint64);
+uint64          timerafterticks(uint);
+uint64          timerleft(uint64);
+void            timerarm(void);
+void            timerslice(uint);
+int             timersliceover(void);
+int             timersleep(uint64);
 
 // gpio.c
 void            set_pinmode(int pin, enum pinmode mode);
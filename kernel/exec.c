@@ -5,23 +5,29 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
 #include "elf.h"
+#include "fcntl.h"
 
-extern uint64 asid_gen;
-
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
-
+// Replace p's user image with the program path, run with
+// arguments argv. p is the current process, or spawn()'s
+// new child that has never run.
+// Returns argc, or -1 with p's old image left as it was.
 int
-exec(char *path, char **argv)
+exec(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
+  uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase, oldctxid;
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct vma vma[NVMA], *v;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+
+  memset(vma, 0, sizeof(vma));
 
   begin_op();
 
@@ -40,7 +46,8 @@ exec(char *path, char **argv)
   if((pagetable = uvmcreate()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record where each segment comes from in the file.
+  // Its pages are read in on first touch (see uvmfault()).
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -50,20 +57,32 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= MMAPBASE)
       goto bad;
-    sz = sz1;
     if((ph.vaddr % PGSIZE) != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.vaddr < sz)
+      goto bad;
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
+    if(ph.memsz == 0)
+      continue;
+    for(v = vma; v < &vma[NVMA] && v->ip; v++)
+      ;
+    if(v == &vma[NVMA])
+      goto bad;
+    v->start = ph.vaddr;
+    v->end = ph.vaddr + ph.memsz;
+    v->prot = PROT_READ | PROT_WRITE | PROT_EXEC;
+    v->off = ph.off;
+    v->filesz = ph.filesz;
+    v->ip = idup(ip);
+    sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
@@ -111,52 +130,41 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  mmapfree(p);
+  begin_op();
+  vmaput(p->vma);
+  end_op();
+  memmove(p->vma, vma, sizeof(vma));
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
   p->trapframe->elr = elf.entry;  // initial program counter = main
   p->trapframe->spsr = 0;     // switch to EL0
   p->trapframe->sp = sp; // initial stack pointer
-  p->ctxid = asid_gen++;
-  switchuvm(p);
+  // the old ASID's TLB entries belong to the old page
+  // table; give it back once the new one is in use.
+  oldctxid = p->ctxid;
+  p->ctxid = 0;
+  if(p == myproc()){
+    switchuvm(p);
+    fpreset(p);
+  }
+  asidfree(oldctxid);
   uvmfree(oldpagetable, oldsz);
 
-  for(uint64 i = 0; i < p->sz; i += PGSIZE)
-    cpu_sync_cache((void *)i, PGSIZE);
-
   return argc; // this ends up in x0, the first argument to main(argc, argv)
 
  bad:
   if(pagetable)
     uvmfree(pagetable, sz);
   if(ip){
+    vmaput(vma);
     iunlockput(ip);
     end_op();
+  } else {
+    begin_op();
+    vmaput(vma);
+    end_op();
   }
   return -1;
 }
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = uva2ka(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
-  return 0;
-}
@@ -0,0 +1,148 @@
+// Flattened device tree (DTB), just enough of it to find
+// the machine's RAM.
+//
+// The boot loader (the Raspberry Pi firmware or qemu) leaves
+// the physical address of a DTB in x0; entry.S passes it on
+// to main(). The blob is big-endian: a header, a memory
+// reservation block of (address, size) pairs, and a
+// structure block of tokens describing a tree of nodes, each
+// with properties whose names live in a strings block.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "aarch64.h"
+#include "defs.h"
+
+#define FDT_MAGIC       0xd00dfeed
+#define FDT_BEGIN_NODE  1
+#define FDT_END_NODE    2
+#define FDT_PROP        3
+#define FDT_NOP         4
+#define FDT_END         9
+
+// header fields, as offsets in bytes.
+#define FDT_TOTALSIZE   4
+#define FDT_OFF_STRUCT  8
+#define FDT_OFF_STRINGS 12
+#define FDT_OFF_RSVMAP  16
+
+// the blob need not be aligned, so read it a byte at a time.
+static uint32
+be32(void *p)
+{
+  uchar *b = p;
+  return (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+static uint64
+be64(void *p)
+{
+  return ((uint64)be32(p) << 32) | be32((char*)p + 4);
+}
+
+// Read a number that is cells 32-bit cells long.
+static uint64
+cells(void *p, int cells)
+{
+  return cells == 2 ? be64(p) : be32(p);
+}
+
+static int
+fdtok(char *fdt)
+{
+  return fdt != 0 && be32(fdt) == FDT_MAGIC;
+}
+
+// Does node name name (e.g. "memory@0") have base name base?
+static int
+nodeis(char *name, char *base)
+{
+  int n = strlen(base);
+  return strncmp(name, base, n) == 0 && (name[n] == 0 || name[n] == '@');
+}
+
+// Store the RAM banks that the tree's memory nodes list
+// in mem[0..max-1], in the order they appear.
+// Returns the number of banks, 0 if fdt is not a DTB.
+int
+fdt_memory(void *blob, struct membank *mem, int max)
+{
+  char *fdt = blob, *p, *strs, *name;
+  int depth = 0, inmem = 0, acells = 2, scells = 1, n = 0;
+  uint32 tok, len;
+  char *end;
+
+  if(!fdtok(fdt))
+    return 0;
+  p = fdt + be32(fdt + FDT_OFF_STRUCT);
+  strs = fdt + be32(fdt + FDT_OFF_STRINGS);
+  end = fdt + be32(fdt + FDT_TOTALSIZE);
+
+  while(p < end){
+    tok = be32(p);
+    p += 4;
+    switch(tok){
+    case FDT_BEGIN_NODE:
+      name = p;
+      p += (strlen(name) + 4) & ~3;   // name, NUL, padding
+      depth++;
+      inmem = depth == 2 && nodeis(name, "memory");
+      break;
+    case FDT_END_NODE:
+      depth--;
+      inmem = 0;
+      break;
+    case FDT_PROP:
+      len = be32(p);
+      name = strs + be32(p + 4);
+      p += 8;
+      if(depth == 1 && strncmp(name, "#address-cells", 15) == 0)
+        acells = be32(p);
+      else if(depth == 1 && strncmp(name, "#size-cells", 12) == 0)
+        scells = be32(p);
+      else if(inmem && strncmp(name, "reg", 4) == 0){
+        // (address, size) pairs of the root's cell sizes.
+        for(uint off = 0; off + 4*(acells+scells) <= len && n < max; off += 4*(acells+scells)){
+          mem[n].base = cells(p + off, acells);
+          mem[n].end = mem[n].base + cells(p + off + 4*acells, scells);
+          if(mem[n].end > mem[n].base)
+            n++;
+        }
+      }
+      p += (len + 3) & ~3;
+      break;
+    case FDT_NOP:
+      break;
+    case FDT_END:
+      return n;
+    default:
+      return n;   // corrupt
+    }
+  }
+  return n;
+}
+
+// Store the ranges in the tree's memory reservation block,
+// which the kernel must not allocate, in resv[0..max-1].
+// Returns the number of ranges.
+int
+fdt_reserved(void *blob, struct membank *resv, int max)
+{
+  char *fdt = blob, *p;
+  uint64 base, size;
+  int n = 0;
+
+  if(!fdtok(fdt))
+    return 0;
+  for(p = fdt + be32(fdt + FDT_OFF_RSVMAP); n < max; p += 16){
+    base = be64(p);
+    size = be64(p + 8);
+    if(base == 0 && size == 0)
+      break;
+    resv[n].base = base;
+    resv[n].end = base + size;
+    n++;
+  }
+  return n;
+}
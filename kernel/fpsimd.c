@@ -0,0 +1,94 @@
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "aarch64.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// FP/SIMD registers of user processes, switched lazily.
+//
+// The kernel never uses the FP/SIMD registers, so they only
+// ever hold user state. A process starts each turn on a CPU
+// with CPACR_EL1 trapping its FP/SIMD instructions. The first
+// one traps to fptrap(), which turns the unit on and loads
+// the process's registers, unless they are still in this
+// CPU's unit from the last time the process ran here.
+// A process that used the unit saves it when it gives up the
+// CPU, since it may run next on another one. A process that
+// never uses FP/SIMD costs nothing.
+
+// in fpasm.S
+void fpsave(struct fpsimd*);
+void fpload(struct fpsimd*);
+
+static void
+fpen(uint64 fpen)
+{
+  w_cpacr_el1((r_cpacr_el1() & ~CPACR_FPEN(3)) | fpen);
+  isb();
+}
+
+static int
+fpon(void)
+{
+  return (r_cpacr_el1() & CPACR_FPEN(3)) == CPACR_FPEN_ALL;
+}
+
+void
+fpinithart(void)
+{
+  fpen(CPACR_FPEN_EL0);
+}
+
+// User process p executed an FP/SIMD instruction with the
+// unit off. Called from usertrap() with interrupts off.
+void
+fptrap(struct proc *p)
+{
+  struct cpu *c = mycpu();
+
+  fpen(CPACR_FPEN_ALL);
+  if(c->fpowner != p || p->fpcpu != cpuid()){
+    fpload(&p->fp);
+    c->fpowner = p;
+    p->fpcpu = cpuid();
+    p->nfpload++;
+  }
+}
+
+// p is giving up the CPU in sched(): save its FP/SIMD
+// registers if it used them, and trap the next use.
+void
+fpswitch(struct proc *p)
+{
+  if(fpon()){
+    if(p->state != ZOMBIE)
+      fpsave(&p->fp);
+    fpen(CPACR_FPEN_EL0);
+  }
+}
+
+// Bring p->fp up to date with the registers,
+// for fork() to copy. p is the current process.
+void
+fpflush(struct proc *p)
+{
+  push_off();
+  if(fpon())
+    fpsave(&p->fp);
+  pop_off();
+}
+
+// Give the current process p zeroed FP/SIMD registers,
+// for exec().
+void
+fpreset(struct proc *p)
+{
+  push_off();
+  memset(&p->fp, 0, sizeof(p->fp));
+  p->fpcpu = -1;
+  if(fpon())
+    fpen(CPACR_FPEN_EL0);
+  pop_off();
+}
@@ -22,6 +22,7 @@
 #define D_IPRIORITYR(n) (0x400 + (uint64)(n) * 4)
 #define D_ITARGETSR(n)  (0x800 + (uint64)(n) * 4)
 #define D_ICFGR(n)      (0xc00 + (uint64)(n) * 4)
+#define D_SGIR          0xf00
 
 #define C_CTLR  0x0 
 #define C_PMR   0x4
@@ -50,7 +51,6 @@ gicdinit()
 void
 gicv2init()
 {
-  gic_setup_ppi(TIMER0_IRQ);
   gic_setup_spi(UART0_IRQ);
 }
 
@@ -60,6 +60,10 @@ gicv2inithart()
   giccinit();
   gicdinit();
 
+  // SGIs and PPIs are banked: each CPU enables its own.
+  gic_setup_ppi(TIMER0_IRQ);
+  gic_setup_ppi(IPI_WAKE);
+
   *RegC(C_CTLR) |= 0x1;
   *RegD(D_CTLR) |= 0x1;
 }
@@ -133,3 +137,11 @@ gic_eoi(uint32 iar)
   *RegC(C_EOIR) = iar;
 }
 
+// send software-generated interrupt intid to CPU cpu.
+void
+gic_send_sgi(int cpu, uint32 intid)
+{
+  __sync_synchronize();
+  *RegD(D_SGIR) = ((uint32)1 << (16 + cpu)) | (intid & 0xf);
+}
+
@@ -1,6 +1,27 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or naturally aligned blocks of 2^order pages.
+//
+// Free memory is kept by a buddy allocator: kmem.free[k]
+// lists the free blocks of 2^k pages, and a freed block is
+// merged with its buddy whenever that is free too.
+//
+// The RAM to manage comes from the device tree; see meminit().
+// The per-page state array is sized to match and sits just
+// after the kernel.
+//
+// Each CPU keeps a small cache of free single pages so that
+// most kalloc()s and kfree()s touch only that CPU's cache,
+// not the global kmem.lock. A cache refills from and drains
+// to the buddy allocator KCACHE_BATCH pages at a time.
+//
+// kalloc() does not zero pages. kalloc_zeroed() does, and
+// takes them from a pool that idle CPUs keep filled with
+// pages they zeroed ahead of time (see kzerofill()).
+//
+// With KDEBUG (make KDEBUG=1), kalloc() and kfree() fill pages
+// with junk to catch uninitialized use and dangling references.
 
 #include "types.h"
 #include "param.h"
@@ -10,79 +31,632 @@
 #include "defs.h"
 
 void freerange(void *vstart, void *vend);
+static void kmemlock(void);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// a free page or block. prev is only used by the
+// buddy lists, not the per-CPU caches.
 struct run {
   struct run *next;
+  struct run *prev;
+};
+
+// per-page state, indexed by physical page number.
+struct page {
+  int ref;     // references, for copy-on-write; 0 if free
+  char order;  // order of the free block this page heads
+  char free;   // heads a block on kmem.free[order]
 };
 
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run free[MAXORDER+1];   // circular lists of free blocks
+  int nfree[MAXORDER+1];         // blocks on each list
+  int npages;                    // free pages, all orders
+  uint nlock;                    // acquisitions of lock
+  uint ncontend;                 // ... that found it already held
+  uint nfragfail;                // kalloc_order() failures with enough free pages
+  struct page *page;             // phystop/PGSIZE entries, after end
 } kmem;
 
+struct membank membank[NMEMBANK];  // RAM, from the device tree
+int nmembank;
+uint64 phystop;                    // end of the highest bank
+
+static struct membank resv[NMEMBANK];  // reserved for the firmware
+static int nresv;
+
+#define PAGE(va)  (&kmem.page[V2P(va) / PGSIZE])
+#define PGREF(va) (PAGE(va)->ref)
+
+#define KCACHE_BATCH  16
+#define KCACHE_MAX    (2*KCACHE_BATCH)
+
+// A CPU's cache of free pages. Only its own CPU uses it,
+// except when another CPU runs out of memory and steals
+// from it, so the lock is almost never contended.
+// Aligned so that no two caches share a cache line.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;                    // pages on freelist
+  uint nhit;                // kalloc()s served from the cache
+  uint nrefill;             // refills from the buddy allocator
+  uint ndrain;              // drains to the buddy allocator
+  uint nsteal;              // refills stolen from other CPUs
+} __attribute__((aligned(64)));
+
+struct kcache kcache[NCPU];
+
+#define KZERO_MAX    64   // pages in the pre-zeroed pool
+#define KZERO_BATCH  8    // pages zeroed per kzerofill()
+
+// Pages zeroed ahead of time, except that r->next is in use.
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+  uint nhit;                // kalloc_zeroed()s served from the pool
+  uint nmiss;               // ... that had to zero a page
+} kzero;
+
+// Find the banks of RAM and the ranges reserved for the
+// firmware from the flattened device tree at physical address
+// dtb, or assume PHYSTOP_DEFAULT bytes of RAM if there is no
+// device tree. Until kvminithart() only the first BOOTMEMTOP
+// bytes are mapped, so that is where the tree must be.
+void
+meminit(uint64 dtb)
+{
+  struct membank *b;
+  void *fdt = 0;
+
+  if(dtb != 0 && dtb < BOOTMEMTOP - PGSIZE)
+    fdt = P2V(dtb);
+  nmembank = fdt ? fdt_memory(fdt, membank, NMEMBANK) : 0;
+  if(nmembank == 0){
+    printf("meminit: no device tree, assuming %dMB\n", (int)(PHYSTOP_DEFAULT >> 20));
+    membank[0].base = 0;
+    membank[0].end = PHYSTOP_DEFAULT;
+    nmembank = 1;
+  } else {
+    nresv = fdt_reserved(fdt, resv, NMEMBANK);
+  }
+
+  phystop = 0;
+  for(b = membank; b < &membank[nmembank]; b++){
+    b->base = PGROUNDUP(b->base);
+    b->end = PGROUNDDOWN(b->end);
+    if(b->end > MAXPHYS)
+      b->end = MAXPHYS;
+    if(b->base >= b->end){
+      // unusable; drop it.
+      *b-- = membank[--nmembank];
+      continue;
+    }
+    if(b->end > phystop)
+      phystop = b->end;
+  }
+  if(nmembank == 0)
+    panic("meminit: no memory");
+  for(b = membank; b < &membank[nmembank]; b++)
+    printf("memory: %p-%p\n", b->base, b->end);
+}
+
+// Is the page at physical address pa RAM that
+// kalloc() may hand out?
+static int
+isfree(uint64 pa)
+{
+  struct membank *b;
+  int ram = 0;
+
+  for(b = membank; b < &membank[nmembank]; b++)
+    if(pa >= b->base && pa + PGSIZE <= b->end)
+      ram = 1;
+  for(b = resv; b < &resv[nresv]; b++)
+    if(pa < b->end && pa + PGSIZE > b->base)
+      return 0;
+  return ram;
+}
+
+// Set up the allocator and free the RAM in [vstart, vend),
+// which must be mapped by entry.S's boot page table.
+// vstart is the end of the kernel; kmem.page goes there.
 void
 kinit1(void *vstart, void *vend)
 {
+  uint64 sz = (phystop / PGSIZE) * sizeof(struct page);
+
   initlock(&kmem.lock, "kmem");
+  for(int k = 0; k <= MAXORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
+  initlock(&kzero.lock, "kzero");
+
+  kmem.page = (struct page*)PGROUNDUP((uint64)vstart);
+  vstart = (char*)kmem.page + PGROUNDUP(sz);
+  if((char*)vstart > (char*)P2V(BOOTMEMTOP))
+    panic("kinit1: page array");
+  memset(kmem.page, 0, sz);
   freerange(vstart, vend);
 }
 
+// Free the RAM in [vstart, vend), once the kernel
+// page table maps all of it.
 void
 kinit2(void *vstart, void *vend)
 {
   freerange(vstart, vend);
 }
 
+// Put the block of 2^order pages at r on its free list.
+// kmem.lock must be held.
+static void
+buddy_push(struct run *r, int order)
+{
+  struct run *h = &kmem.free[order];
+
+  r->next = h->next;
+  r->prev = h;
+  h->next->prev = r;
+  h->next = r;
+  PAGE(r)->order = order;
+  PAGE(r)->free = 1;
+  kmem.nfree[order]++;
+}
+
+// Take the block at r off its free list.
+// kmem.lock must be held.
+static void
+buddy_remove(struct run *r, int order)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  PAGE(r)->free = 0;
+  kmem.nfree[order]--;
+}
+
+// Allocate a block of 2^order pages, splitting a larger
+// block if there is no free one of that size.
+// kmem.lock must be held.
+static struct run *
+buddy_alloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER && kmem.nfree[k] == 0; k++)
+    ;
+  if(k > MAXORDER)
+    return 0;
+
+  r = kmem.free[k].next;
+  buddy_remove(r, k);
+  while(k > order){
+    k--;
+    buddy_push((struct run*)((char*)r + ((uint64)PGSIZE << k)), k);
+  }
+  kmem.npages -= 1 << order;
+  return r;
+}
+
+// Free a block of 2^order pages, merging it with its
+// buddy for as long as the buddy is free as well.
+// kmem.lock must be held.
+static void
+buddy_free(struct run *r, int order)
+{
+  uint64 pa = V2P(r), bpa;
+  struct run *b;
+
+  kmem.npages += 1 << order;
+  while(order < MAXORDER){
+    bpa = pa ^ ((uint64)PGSIZE << order);
+    if(bpa + ((uint64)PGSIZE << order) > phystop)
+      break;
+    b = (struct run*)P2V(bpa);
+    if(!PAGE(b)->free || PAGE(b)->order != order)
+      break;
+    buddy_remove(b, order);
+    pa &= ~((uint64)PGSIZE << order);
+    order++;
+  }
+  buddy_push((struct run*)P2V(pa), order);
+}
+
 void
 freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
-    kfree(p);
+  if((char*)vend > (char*)P2V(phystop))
+    vend = P2V(phystop);
+  acquire(&kmem.lock);
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    if(!isfree(V2P(p)))
+      continue;
+    PGREF(p) = 0;
+    buddy_free((struct run*)p, 0);
+  }
+  release(&kmem.lock);
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by va, which normally should have been returned by a
+// call to kalloc(), and free it once the last reference
+// is gone.  (The exception is when initializing the
+// allocator; see kinit above.)
 void
 kfree(void *va)
 {
-  struct run *r;
+  struct run *r, *head = 0;
+  struct kcache *kc;
+  int i;
 
-  if(((uint64)va % PGSIZE) != 0 || (char*)va < end || (uint64)va >= (uint64)P2V(PHYSTOP))
+  if(((uint64)va % PGSIZE) != 0 || (char*)va < end || (uint64)va >= (uint64)P2V(phystop))
     panic("kfree");
 
+  int ref = __sync_sub_and_fetch(&PGREF(va), 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
+
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(va, 1, PGSIZE);
+#endif
 
   r = (struct run*)va;
 
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->n++;
+  if(kc->n > KCACHE_MAX){
+    // give a batch back to the buddy allocator.
+    head = kc->freelist;
+    for(i = 1; i < KCACHE_BATCH; i++)
+      r = r->next;
+    kc->freelist = r->next;
+    r->next = 0;
+    kc->n -= KCACHE_BATCH;
+    kc->ndrain++;
+  }
+  release(&kc->lock);
+
+  if(head){
+    kmemlock();
+    while((r = head) != 0){
+      head = r->next;
+      buddy_free(r, 0);
+    }
+    release(&kmem.lock);
+  }
+  pop_off();
+}
+
+// Acquire kmem.lock, counting contention.
+static void
+kmemlock(void)
+{
+  int busy = kmem.lock.locked;  // a racy peek, good enough for statistics
+
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  kmem.nlock++;
+  if(busy)
+    kmem.ncontend++;
+}
+
+// Refill this CPU's empty cache kc with a batch of pages
+// from the buddy allocator or, if that is empty, half of
+// another CPU's cache. Returns one of the pages for the
+// caller to use, or 0 if there is no free memory anywhere.
+// Interrupts must be disabled.
+static struct run *
+krefill(struct kcache *kc)
+{
+  struct run *head = 0, *tail = 0, *r;
+  struct kcache *o;
+  int n = 0;
+
+  kmemlock();
+  while(n < KCACHE_BATCH && (r = buddy_alloc(0)) != 0){
+    r->next = head;
+    if(head == 0)
+      tail = r;
+    head = r;
+    n++;
+  }
   release(&kmem.lock);
+
+  for(o = kcache; head == 0 && o < &kcache[NCPU]; o++){
+    if(o == kc)
+      continue;
+    acquire(&o->lock);
+    if(o->n > 0){
+      n = (o->n + 1) / 2;
+      head = tail = o->freelist;
+      for(int i = 1; i < n; i++)
+        tail = tail->next;
+      o->freelist = tail->next;
+      o->n -= n;
+      kc->nsteal++;
+    }
+    release(&o->lock);
+  }
+
+  if(head == 0)
+    return 0;
+
+  r = head;
+  head = head->next;
+  n--;
+  acquire(&kc->lock);
+  if(head){
+    tail->next = kc->freelist;
+    kc->freelist = head;
+    kc->n += n;
+  }
+  kc->nrefill++;
+  release(&kc->lock);
+  return r;
+}
+
+// Take a page from the pre-zeroed pool, or return 0.
+static struct run *
+kzeroget(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.n--;
+  }
+  release(&kzero.lock);
+  if(r)
+    r->next = 0;
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
+// Its contents are undefined; see kalloc_zeroed().
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 void *
 kalloc(void)
 {
+  struct kcache *kc;
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+    kc->nhit++;
+  }
+  release(&kc->lock);
+  if(r == 0)
+    r = krefill(kc);
+  pop_off();
+  if(r == 0)
+    r = kzeroget();   // the last free pages may be there
+
+  if(r){
+#ifdef KDEBUG
+    memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+    PGREF(r) = 1;
+  }
+  return (void*)r;
+}
+
+// Allocate one zeroed page, from the pool that idle CPUs
+// keep if it has one.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if((r = kzeroget()) != 0){
+    kzero.nhit++;   // racy, good enough for statistics
+    PGREF(r) = 1;
+    return (void*)r;
+  }
+  kzero.nmiss++;
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Zero a few free pages for kalloc_zeroed(), if its pool
+// is not full. Called by idle CPUs from scheduler().
+// Returns the number of pages zeroed.
+int
+kzerofill(void)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < KZERO_BATCH && kzero.n < KZERO_MAX; i++){
+    if((r = kalloc()) == 0)
+      break;
+    memset((char*)r, 0, PGSIZE);
+    PGREF(r) = 0;
+    acquire(&kzero.lock);
+    r->next = kzero.freelist;
+    kzero.freelist = r;
+    kzero.n++;
+    release(&kzero.lock);
+  }
+  return i;
+}
+
+// Return the pages sitting in every CPU's cache to the
+// buddy allocator, so that they can merge into larger blocks.
+static void
+kdrainall(void)
+{
+  struct kcache *kc;
+  struct run *head, *r;
+
+  for(kc = kcache; kc < &kcache[NCPU]; kc++){
+    acquire(&kc->lock);
+    head = kc->freelist;
+    kc->freelist = 0;
+    kc->n = 0;
+    release(&kc->lock);
+
+    kmemlock();
+    while((r = head) != 0){
+      head = r->next;
+      buddy_free(r, 0);
+    }
+    release(&kmem.lock);
+  }
+}
+
+// Allocate a physically contiguous block of 2^order pages,
+// aligned to its size, not zeroed. Returns a pointer that the
+// kernel can use, or 0 if there is no free block that large.
+// Free it with kfree_order(); references (see kincref())
+// are counted on the whole block.
+void *
+kalloc_order(int order)
+{
+  struct run *r;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order > MAXORDER)
+    return 0;
+
+  kmemlock();
+  r = buddy_alloc(order);
   release(&kmem.lock);
 
+  if(r == 0){
+    // free pages held in the per-CPU caches may be
+    // what keeps blocks from merging.
+    kdrainall();
+    kmemlock();
+    r = buddy_alloc(order);
+    if(r == 0 && kmem.npages >= (1 << order))
+      kmem.nfragfail++;
+    release(&kmem.lock);
+  }
+
   if(r)
-    memset((char*)r, 0, PGSIZE); // fill with junk
+    PGREF(r) = 1;
   return (void*)r;
 }
+
+// Drop a reference to a block returned by kalloc_order(order)
+// and free it once the last reference is gone.
+void
+kfree_order(void *va, int order)
+{
+  if(order == 0){
+    kfree(va);
+    return;
+  }
+  if(order < 0 || order > MAXORDER)
+    panic("kfree_order: order");
+  if(((uint64)va % ((uint64)PGSIZE << order)) != 0 || (char*)va < end ||
+     (uint64)va + ((uint64)PGSIZE << order) > (uint64)P2V(phystop))
+    panic("kfree_order");
+
+  int ref = __sync_sub_and_fetch(&PGREF(va), 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree_order: ref");
+
+#ifdef KDEBUG
+  // Fill with junk to catch dangling refs.
+  memset(va, 1, (uint64)PGSIZE << order);
+#endif
+
+  kmemlock();
+  buddy_free((struct run*)va, order);
+  release(&kmem.lock);
+}
+
+// Turn a block returned by kalloc_order(order), which must
+// have a single reference, into 2^order pages, each with a
+// reference of its own to be dropped by kfree().
+void
+ksplit(void *va, int order)
+{
+  if(order < 0 || order > MAXORDER || PGREF(va) != 1)
+    panic("ksplit");
+  for(int i = 1; i < (1 << order); i++)
+    PGREF((char*)va + i*PGSIZE) = 1;
+}
+
+// Add a reference to a page returned by kalloc(),
+// or a block returned by kalloc_order(),
+// e.g. when a copy-on-write fork shares it.
+// Each reference is dropped by one kfree().
+void
+kincref(void *va)
+{
+  if(((uint64)va % PGSIZE) != 0 || (char*)va < end || (uint64)va >= (uint64)P2V(phystop))
+    panic("kincref");
+
+  if(__sync_fetch_and_add(&PGREF(va), 1) < 1)
+    panic("kincref: free page");
+}
+
+// Number of references to a page returned by kalloc().
+int
+krefcnt(void *va)
+{
+  return PGREF(va);
+}
+
+// Print free memory by block size, fragmentation and
+// lock statistics.
+// For debugging; runs when user types ^P on console.
+void
+kmemdump(void)
+{
+  struct kcache *kc;
+  int k, top;
+
+  acquire(&kmem.lock);
+  printf("kmem: %d free pages, lock %d acquired %d contended\n",
+         kmem.npages, kmem.nlock, kmem.ncontend);
+  printf("kmem: free blocks by order:");
+  top = -1;
+  for(k = 0; k <= MAXORDER; k++){
+    printf(" %d", kmem.nfree[k]);
+    if(kmem.nfree[k])
+      top = k;
+  }
+  printf("\n");
+  // the share of free memory that is not in the largest
+  // free blocks; 0 means unfragmented.
+  if(top >= 0)
+    printf("kmem: fragmentation %d%%, largest block order %d, %d failed kalloc_order\n",
+           100 - 100 * (kmem.nfree[top] << top) / kmem.npages, top, kmem.nfragfail);
+  release(&kmem.lock);
+
+  for(kc = kcache; kc < &kcache[NCPU]; kc++){
+    printf("kcache%d: %d pages, hit %d refill %d drain %d steal %d\n",
+           (int)(kc - kcache), kc->n, kc->nhit, kc->nrefill, kc->ndrain, kc->nsteal);
+  }
+  printf("kzero: %d pages, hit %d miss %d\n", kzero.n, kzero.nhit, kzero.nmiss);
+}
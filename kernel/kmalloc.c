@@ -0,0 +1,252 @@
+// Slab allocator for kernel objects smaller than a page,
+// built on kalloc().
+//
+// A kmcache hands out objects of one size. It carves pages
+// ("slabs") into equal objects; each slab starts with a
+// struct slab header that lists its free objects, so
+// kmfree() finds an object's slab and cache from its address.
+// Each CPU keeps a magazine of free objects per cache, so
+// that most allocations and frees don't take the cache lock.
+//
+// kmalloc() serves any size up to KMALLOC_MAX from a set of
+// power-of-two caches; heavily used objects such as pipes and
+// files get a cache of their own from kmcache_create().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "aarch64.h"
+#include "defs.h"
+
+#define NKMCACHE      16    // maximum number of caches
+#define MAGSIZE       8     // objects in a per-CPU magazine
+#define KMALLOC_MIN   32    // smallest kmalloc() size class
+#define KMALLOC_MAX   2048  // largest kmalloc() size class
+#define NKMALLOC      7     // kmalloc() size classes, KMALLOC_MIN..KMALLOC_MAX
+#define SLABHDR       64    // bytes reserved for struct slab
+
+struct obj {
+  struct obj *next;
+};
+
+// header at the start of each slab page.
+struct slab {
+  struct slab *next;        // on the cache's list of partial slabs
+  struct slab *prev;
+  struct kmcache *cache;
+  struct obj *free;         // free objects in this slab
+  int inuse;                // objects handed out (or in magazines)
+};
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+} __attribute__((aligned(64)));
+
+struct kmcache {
+  struct spinlock lock;
+  char *name;
+  uint size;                // object size
+  int perslab;              // objects per slab
+  struct slab partial;      // circular list of slabs with free objects
+  int nslab;                // slabs allocated
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  int n;
+  struct kmcache cache[NKMCACHE];
+} kmcaches;
+
+static struct kmcache *kmalloc_cache[NKMALLOC];
+
+void
+kmallocinit(void)
+{
+  static char *names[NKMALLOC] = {
+    "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256",
+    "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+  };
+  uint size;
+  int i;
+
+  initlock(&kmcaches.lock, "kmcaches");
+  for(i = 0, size = KMALLOC_MIN; size <= KMALLOC_MAX; i++, size *= 2)
+    kmalloc_cache[i] = kmcache_create(names[i], size);
+}
+
+// Create a cache of objects of size bytes (at most
+// KMALLOC_MAX). Caches are never destroyed.
+struct kmcache*
+kmcache_create(char *name, uint size)
+{
+  struct kmcache *c;
+
+  if(size == 0 || size > KMALLOC_MAX)
+    panic("kmcache_create: size");
+  size = (size + 7) & ~7;
+
+  acquire(&kmcaches.lock);
+  if(kmcaches.n == NKMCACHE)
+    panic("kmcache_create: too many caches");
+  c = &kmcaches.cache[kmcaches.n++];
+  release(&kmcaches.lock);
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  c->partial.next = c->partial.prev = &c->partial;
+  return c;
+}
+
+// Take an object from one of c's slabs, allocating a new
+// slab if none has a free object.
+// c->lock must be held.
+static void*
+slab_get(struct kmcache *c)
+{
+  struct slab *s;
+  struct obj *o;
+  char *p;
+
+  s = c->partial.next;
+  if(s == &c->partial){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->inuse = 0;
+    s->free = 0;
+    for(p = (char*)s + SLABHDR + (c->perslab-1) * c->size; p >= (char*)s + SLABHDR; p -= c->size){
+      o = (struct obj*)p;
+      o->next = s->free;
+      s->free = o;
+    }
+    s->next = c->partial.next;
+    s->prev = &c->partial;
+    c->partial.next->prev = s;
+    c->partial.next = s;
+    c->nslab++;
+  }
+
+  o = s->free;
+  s->free = o->next;
+  s->inuse++;
+  if(s->free == 0){
+    // full; off the partial list.
+    s->prev->next = s->next;
+    s->next->prev = s->prev;
+  }
+  return o;
+}
+
+// Return an object to its slab, and the slab to kalloc()
+// once it is empty, unless it is c's only partial slab.
+// c->lock must be held.
+static void
+slab_put(struct kmcache *c, void *p)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)p);
+  struct obj *o = p;
+
+  if(s->free == 0){
+    // was full; back on the partial list.
+    s->next = c->partial.next;
+    s->prev = &c->partial;
+    c->partial.next->prev = s;
+    c->partial.next = s;
+  }
+  o->next = s->free;
+  s->free = o;
+  s->inuse--;
+
+  if(s->inuse == 0 && !(s->next == &c->partial && s->prev == &c->partial)){
+    s->prev->next = s->next;
+    s->next->prev = s->prev;
+    c->nslab--;
+    kfree(s);
+  }
+}
+
+// Allocate a zeroed object from cache c.
+// Returns 0 if out of memory.
+void*
+kmcache_alloc(struct kmcache *c)
+{
+  struct magazine *m;
+  void *p = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    // refill half the magazine.
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (p = slab_get(c)) != 0)
+      m->obj[m->n++] = p;
+    release(&c->lock);
+    p = 0;
+  }
+  if(m->n > 0)
+    p = m->obj[--m->n];
+  pop_off();
+
+  if(p)
+    memset(p, 0, c->size);
+  return p;
+}
+
+// Allocate a zeroed object of at least size bytes.
+// Returns 0 if out of memory or size > KMALLOC_MAX.
+void*
+kmalloc(uint size)
+{
+  uint csize;
+  int i;
+
+  for(i = 0, csize = KMALLOC_MIN; csize <= KMALLOC_MAX; i++, csize *= 2){
+    if(size <= csize)
+      return kmcache_alloc(kmalloc_cache[i]);
+  }
+  return 0;
+}
+
+// Free an object returned by kmalloc() or kmcache_alloc().
+void
+kmfree(void *p)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)p);
+  struct kmcache *c = s->cache;
+  struct magazine *m;
+  int i;
+
+  if(c < kmcaches.cache || c >= &kmcaches.cache[kmcaches.n] ||
+     ((uint64)p - (uint64)s - SLABHDR) % c->size != 0)
+    panic("kmfree");
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    // drain half the magazine.
+    acquire(&c->lock);
+    for(i = 0; i < MAGSIZE/2; i++)
+      slab_put(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = p;
+  pop_off();
+}
+
+// Print the caches' slab usage.
+// For debugging; runs when user types ^P on console.
+void
+kmallocdump(void)
+{
+  struct kmcache *c;
+
+  for(c = kmcaches.cache; c < &kmcaches.cache[kmcaches.n]; c++){
+    printf("%s: size %d, %d objs/slab, %d slabs\n",
+           c->name, c->size, c->perslab, c->nslab);
+  }
+}
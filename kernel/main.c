@@ -13,12 +13,13 @@ void cpu2_wakeup(uint64 entry);
 void cpu3_wakeup(uint64 entry);
 
 // start() jumps here in EL1 on all CPUs.
+// dtb is the physical address of the device tree, on CPU 0.
 void
-main()
+main(uint64 dtb)
 {
   if(cpuid() == 0){
-    trapinit();      // trap vectors
     trapinithart();  // install trap vector
+    fpinithart();    // trap user FP/SIMD
     consoleinit();
     printfinit();
     printf("\n");
@@ -28,11 +29,13 @@ main()
     cpu2_wakeup(V2P(_entry));
     cpu3_wakeup(V2P(_entry));
     __sync_synchronize(); 
-    //kinit1(end, (void*)SECTROUNDUP((uint64)end));  // physical page allocator
-    kinit1(end, P2V(PHYSTOP));  // physical page allocator
+    meminit(dtb);    // find RAM in the device tree
+    kinit1(end, P2V(BOOTMEMTOP));  // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
-    //kinit2((void*)SECTROUNDUP((uint64)end), P2V(PHYSTOP));
+    kinit2(P2V(BOOTMEMTOP), P2V(phystop));  // RAM beyond what entry.S mapped
+    kmallocinit();   // small object allocator
+    memtest();       // check mem.S
     procinit();      // process table
     gicv2init();     // set up interrupt controller
     gicv2inithart();
@@ -40,6 +43,7 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe allocator
     ramdiskinit();
     userinit();      // first user process
     __sync_synchronize();
@@ -51,6 +55,7 @@ main()
     kvminithart();    // turn on paging
     printf("hart %d starting\n", cpuid());
     trapinithart();   // install trap vector
+    fpinithart();
     gicv2inithart();
     timerinit();
   }
@@ -12,14 +12,26 @@
 // unused RAM after 40000000.
 
 // the kernel uses physical memory thus:
-// 40000000 -- entry.S, then kernel text and data
-// end -- start of kernel page allocation area
-// PHYSTOP -- end RAM used by the kernel
+// 80000 -- entry.S, then kernel text and data
+// end -- kalloc's per-page array, then start of
+//        kernel page allocation area
+// phystop -- end of the highest bank of RAM, which
+//            meminit() finds in the device tree
 
 #define REG(reg) ((volatile uint32 *)(reg))
 
 #define EXTMEM    0x80000L        // Start PA of extended memory
-#define PHYSTOP   (EXTMEM+128*1024*1024)     // PA of Top SDRAM
+#define PHYSTOP_DEFAULT (EXTMEM+128*1024*1024)  // RAM assumed without a device tree
+#define BOOTMEMTOP 0x40000000L    // entry.S maps the RAM below this
+#define MAXPHYS   (1ULL<<36)      // RAM the kernel can address (TCR_IPS(1))
+
+#ifndef __ASSEMBLER__
+// a bank [base, end) of physical RAM; see meminit().
+struct membank {
+  uint64 base;
+  uint64 end;
+};
+#endif
 
 #define KERNBASE  0xffffff8000000000L     // First kernel virtual address
 #define KERNLINK  (KERNBASE + EXTMEM)     // virtual address where kernel is linked
@@ -33,6 +45,13 @@
 // one beyond the highest possible virtual address.
 #define MAXVA (KERNBASE + (1ULL<<38))
 
+// one beyond the highest user virtual address (TTBR0, T0SZ=25).
+#define MAXUVA (1ULL<<39)
+
+// mmap() regions go in [MMAPBASE, MAXUVA), above anything
+// exec() loads or sbrk() grows.
+#define MMAPBASE (MAXUVA/2)
+
 // rpi4 peripheral base address
 #define RPI4_PERI_BASE  0xfe000000L
 #define RPI4_PERI_END   0x100000000L
@@ -52,6 +71,7 @@
 #define UART0_IRQ   153
 
 #define TIMER0_IRQ    27
+#define IPI_WAKE      1   // SGI that wakes an idle CPU
 
 // interrupt controller GICv2
 #define GICDBASE     P2V_WO(0xff841000)
@@ -0,0 +1,381 @@
+// mmap(), munmap(), mprotect() and msync().
+//
+// mmap() regions live in [MMAPBASE, MAXUVA), above the memory
+// that exec() and sbrk() manage, each described by a struct
+// vma in p->vma[] whose flags hold its MAP_ bits. Like the
+// heap and exec()'s segments, their pages are filled in on
+// first touch by uvmfault(): zero-filled, or read straight
+// from the file's inode into the page that gets mapped, with
+// no read() buffer in between.
+//
+// A MAP_PRIVATE file page is the process's own copy. A
+// MAP_SHARED one is mapped read-only until it is written and
+// is then marked dirty; msync() and munmap() write the dirty
+// pages back to the file through the log. fork() shares the
+// pages a MAP_SHARED region already has with the child; pages
+// either of them faults in later are read separately, and
+// see the other's writes once they have been written back.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "aarch64.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "defs.h"
+#include "fcntl.h"
+
+// in a region's flags only: the file was open for writing,
+// so a MAP_SHARED region may be made writable.
+#define MAP_MAYWRITE    0x1000
+
+// Is v a region made by mmap()?
+static int
+ismmap(struct vma *v)
+{
+  return v->end != 0 && v->flags != 0;
+}
+
+// Are v's writes written back to its file?
+static int
+isshared(struct vma *v)
+{
+  return v->ip != 0 && (v->flags & MAP_SHARED);
+}
+
+static struct vma*
+vmaalloc(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0)
+      return v;
+  }
+  return 0;
+}
+
+// Find room for a region of len bytes, first fit from MMAPBASE.
+// Returns 0 if there is none.
+static uint64
+mmapfind(struct proc *p, uint64 len)
+{
+  struct vma *v;
+  uint64 a;
+
+  a = MMAPBASE;
+ again:
+  if(a + len > MAXUVA || a + len < a)
+    return 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(ismmap(v) && v->start < a + len && v->end > a){
+      a = v->end;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Make a a boundary between p's mmap() regions, splitting the
+// region that contains it, if any.
+// Returns 0 on success, -1 if there is no free struct vma.
+static int
+mmapsplit(struct proc *p, uint64 a)
+{
+  struct vma *v, *w;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(ismmap(v) && v->start < a && a < v->end)
+      break;
+  }
+  if(v == &p->vma[NVMA])
+    return 0;
+  if((w = vmaalloc(p)) == 0)
+    return -1;
+  *w = *v;
+  w->start = a;
+  w->off += a - v->start;
+  if(v->filesz > a - v->start){
+    w->filesz = v->filesz - (a - v->start);
+    v->filesz = a - v->start;
+  } else {
+    w->filesz = 0;
+  }
+  if(w->ip)
+    idup(w->ip);
+  v->end = a;
+  return 0;
+}
+
+// Is [start, end) a valid range for an mmap() region?
+static int
+mmaprange(uint64 start, uint64 end)
+{
+  return start % PGSIZE == 0 && start >= MMAPBASE && end > start && end <= MAXUVA;
+}
+
+// Is all of [start, end) in mmap() regions?
+static int
+mmapcovered(struct proc *p, uint64 start, uint64 end)
+{
+  struct vma *v;
+  uint64 a;
+
+  for(a = start; a < end; a = v->end){
+    for(v = p->vma; v < &p->vma[NVMA]; v++){
+      if(ismmap(v) && v->start <= a && a < v->end)
+        break;
+    }
+    if(v == &p->vma[NVMA])
+      return 0;
+  }
+  return 1;
+}
+
+// Write the dirty pages of MAP_SHARED region v in [start, end)
+// back to its file, a few blocks per transaction as
+// filewrite() does. Data past the file's current end, e.g.
+// after a truncation, is dropped.
+// Returns 0 on success, -1 on a write error.
+static int
+mmapsync(struct proc *p, struct vma *v, uint64 start, uint64 end)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint64 a, ka;
+  uint off, n, i, n1;
+  int r = 0;
+
+  for(a = start; a < end && a - v->start < v->filesz; a += PGSIZE){
+    if((ka = uvmclean(p->pagetable, a)) == 0)
+      continue;
+    off = v->off + (a - v->start);
+    n = v->filesz - (a - v->start);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    for(i = 0; i < n; i += n1){
+      n1 = n - i;
+      if(n1 > max)
+        n1 = max;
+      begin_op();
+      ilock(v->ip);
+      if(off + i >= v->ip->size){
+        n1 = n - i;
+      } else {
+        if(n1 > v->ip->size - (off + i))
+          n1 = v->ip->size - (off + i);
+        if(writei(v->ip, 0, ka + i, off + i, n1) != n1)
+          r = -1;
+      }
+      iunlock(v->ip);
+      end_op();
+    }
+  }
+  return r;
+}
+
+// Unmap region v of p, writing it back first if it is
+// MAP_SHARED, and forget it.
+static void
+mmapdrop(struct proc *p, struct vma *v)
+{
+  if(isshared(v))
+    mmapsync(p, v, v->start, v->end);
+  uvmunmap(p->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+  if(v->ip){
+    begin_op();
+    iput(v->ip);
+    end_op();
+  }
+  memset(v, 0, sizeof(*v));
+}
+
+// Make a region of len bytes with access prot, at addr if
+// flags has MAP_FIXED and anywhere otherwise. It maps the
+// file open as fd from offset off, or zero-filled memory if
+// flags has MAP_ANONYMOUS, which must be MAP_PRIVATE.
+// Returns the region's address, or -1.
+uint64
+mmap(uint64 addr, uint64 len, int prot, int flags, int fd, uint64 off)
+{
+  struct proc *p = myproc();
+  struct file *f = 0;
+  struct vma *v;
+  uint size;
+
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) != MAP_SHARED &&
+     (flags & (MAP_SHARED|MAP_PRIVATE)) != MAP_PRIVATE)
+    return -1;
+  if(prot & ~(PROT_READ|PROT_WRITE|PROT_EXEC))
+    return -1;
+  if(len == 0 || len > MAXUVA)
+    return -1;
+  len = PGROUNDUP(len);
+
+  if(flags & MAP_ANONYMOUS){
+    if(flags & MAP_SHARED)
+      return -1;
+  } else {
+    if(fd < 0 || fd >= NOFILE || (f = p->ofile[fd]) == 0 || f->type != FD_INODE)
+      return -1;
+    if(!f->readable || ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable))
+      return -1;
+    if(off % PGSIZE != 0 || off > MAXFILE*BSIZE || len > MAXFILE*BSIZE - off)
+      return -1;
+  }
+
+  if(flags & MAP_FIXED){
+    if(!mmaprange(addr, addr + len) || munmap(addr, len) < 0)
+      return -1;
+  } else if((addr = mmapfind(p, len)) == 0){
+    return -1;
+  }
+  if((v = vmaalloc(p)) == 0)
+    return -1;
+  v->start = addr;
+  v->end = addr + len;
+  v->prot = prot;
+  v->flags = flags & (MAP_SHARED|MAP_PRIVATE|MAP_ANONYMOUS);
+  v->ip = 0;
+  v->off = 0;
+  v->filesz = 0;
+  if(f){
+    if(f->writable)
+      v->flags |= MAP_MAYWRITE;
+    ilock(f->ip);
+    size = f->ip->size;
+    iunlock(f->ip);
+    v->ip = idup(f->ip);
+    v->off = off;
+    if(size > off)
+      v->filesz = size - off < len ? size - off : len;
+  }
+  return addr;
+}
+
+// Remove the mmap() memory in [addr, addr+len), writing back
+// MAP_SHARED pages and freeing the rest.
+// Returns 0 on success, -1 on error.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 end;
+
+  end = addr + PGROUNDUP(len);
+  if(!mmaprange(addr, end))
+    return -1;
+  if(mmapsplit(p, addr) < 0 || mmapsplit(p, end) < 0)
+    return -1;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(ismmap(v) && v->start >= addr && v->end <= end)
+      mmapdrop(p, v);
+  }
+  return 0;
+}
+
+// Change the access of the mmap() memory in [addr, addr+len)
+// to prot. All of it must be mapped.
+// Returns 0 on success, -1 on error.
+int
+mprotect(uint64 addr, uint64 len, int prot)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 end;
+
+  end = addr + PGROUNDUP(len);
+  if(!mmaprange(addr, end) || (prot & ~(PROT_READ|PROT_WRITE|PROT_EXEC)))
+    return -1;
+  if(!mmapcovered(p, addr, end))
+    return -1;
+  if(prot & PROT_WRITE){
+    for(v = p->vma; v < &p->vma[NVMA]; v++){
+      if(isshared(v) && v->start < end && v->end > addr && !(v->flags & MAP_MAYWRITE))
+        return -1;
+    }
+  }
+  if(mmapsplit(p, addr) < 0 || mmapsplit(p, end) < 0)
+    return -1;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(ismmap(v) && v->start >= addr && v->end <= end){
+      v->prot = prot;
+      // shared pages become writable one by one, as they
+      // are written and marked dirty.
+      uvmprotect(p->pagetable, v->start, (v->end - v->start) / PGSIZE,
+                 isshared(v) ? prot & ~PROT_WRITE : prot);
+    }
+  }
+  return 0;
+}
+
+// Write the MAP_SHARED memory in [addr, addr+len) that has
+// changed back to its files, whatever the MS_ flags say.
+// All of it must be mapped.
+// Returns 0 on success, -1 on error.
+int
+msync(uint64 addr, uint64 len, int flags)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 end;
+  int r = 0;
+
+  end = addr + PGROUNDUP(len);
+  if(!mmaprange(addr, end) || (flags & ~(MS_ASYNC|MS_INVALIDATE|MS_SYNC)))
+    return -1;
+  if(!mmapcovered(p, addr, end))
+    return -1;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(isshared(v) && v->start < end && v->end > addr){
+      if(mmapsync(p, v, addr > v->start ? addr : v->start,
+                  end < v->end ? end : v->end) < 0)
+        r = -1;
+    }
+  }
+  return r;
+}
+
+// Give np copies of p's mmap() memory, for fork(), which
+// copies the regions themselves with vmadup().
+// Returns 0 on success, -1 if out of memory.
+int
+mmapcopy(struct proc *p, struct proc *np)
+{
+  struct vma *v, *w;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!ismmap(v))
+      continue;
+    if(uvmcopy(p->pagetable, np->pagetable, v->start, v->end, isshared(v)) < 0){
+      for(w = p->vma; w < v; w++){
+        if(ismmap(w))
+          uvmunmap(np->pagetable, w->start, (w->end - w->start) / PGSIZE, 1);
+      }
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Unmap all of p's mmap() memory, writing back MAP_SHARED
+// pages, and forget the regions, for exec() and exit().
+// freeproc() calls it again, when there is nothing left
+// that would make it sleep.
+void
+mmapfree(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(ismmap(v)){
+      if(p->pagetable)
+        mmapdrop(p, v);
+      else
+        memset(v, 0, sizeof(*v));
+    }
+  }
+}
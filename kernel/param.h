@@ -1,13 +1,21 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          4  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NVMA         16  // demand-paged memory regions per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
+#define NMEMBANK      8  // maximum RAM banks and reserved ranges
+#define MAXORDER     10  // largest kalloc_order() block is 2^MAXORDER pages
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NSPAWNFD      3  // file descriptors spawn() can set up
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICKUS    100000   // microseconds per clock tick at boot
+#define TICKMINUS   1000   // shortest tick schedctl() may set
+#define SLICEUS    10000   // microseconds a process runs before preemption, by default
+#define SLICEMINUS   100   // shortest time slice schedctl() may set
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sched.h"
 
 struct cpu cpus[NCPU];
 
@@ -12,13 +13,64 @@ struct proc proc[NPROC];
 
 struct proc *initproc;
 
-extern uint64 asid_gen;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p, int yielding);
+
+#define NLAT  240   // latency histogram buckets
+
+// Per-CPU run queues: FIFO lists of RUNNABLE processes,
+// linked through p->rqnext. A RUNNABLE process is on exactly
+// one queue, and the CPU that takes it off runs it, so a CPU
+// picks its next process without looking at any other, and
+// takes another CPU's queue lock only to steal from it when
+// its own queue is empty.
+// rq->lock may be acquired while holding a p->lock, but not
+// the other way around.
+struct runq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+  int n;                      // processes queued
+  int online;                 // the CPU has entered scheduler()
+  volatile int idle;          // the CPU is in idle(), or about to be
+
+  // for procdump().
+  int maxn;                   // longest the queue has been
+  int nrun;                   // processes switched to
+  int nsteal;                 // of those, taken from another CPU's queue
+  int nidle;                  // times it waited for an interrupt
+
+  // for schedctl(), while it is measuring: how long the
+  // processes this CPU switched to had waited.
+  uint64 latmax;              // longest, in counter increments
+  uint lat[NLAT];             // histogram; see latbucket()
+} __attribute__((aligned(64)));
+
+static struct runq runqs[NCPU];
+static volatile int latmeasure;   // fill in rq->lat[]
+static uint slicedef = SLICEUS;   // time slice of new processes
+
+// Processes sleeping in sleep(), in queues hashed by channel,
+// so that wakeup() looks only at those that may be sleeping
+// on its channel. A process is linked on its channel's queue,
+// oldest first, from sleep() until the wakeup() or kill() that
+// unlinks it, which then makes it RUNNABLE.
+// wq->lock may be acquired while holding a p->lock, but not
+// the other way around.
+#define NWAITQ 61   // prime, so that the hash uses all the address bits
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+};
+
+static struct waitq waitqs[NWAITQ];
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
@@ -55,6 +107,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runqs[i].lock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
@@ -121,6 +177,8 @@ found:
   // Allocate a trapframe page.
   sp -= sizeof(*p->trapframe);
   p->trapframe = (struct trapframe*)sp;
+  // the stack page is not zeroed; start user registers at 0.
+  memset(p->trapframe, 0, sizeof(*p->trapframe));
 
   // An empty user page table.
   p->pagetable = uvmcreate();
@@ -136,6 +194,12 @@ found:
   p->context.x30 = (uint64)forkret;
   p->context.sp = (uint64)sp;
 
+  // FP/SIMD registers start out zero.
+  memset(&p->fp, 0, sizeof(p->fp));
+  p->fpcpu = -1;
+  p->lastcpu = -1;
+  p->slice = slicedef;
+
   return p;
 }
 
@@ -146,17 +210,26 @@ static void
 freeproc(struct proc *p)
 {
   p->trapframe = 0;
+  mmapfree(p);
+  memset(p->vma, 0, sizeof(p->vma));
   if(p->pagetable)
     uvmfree(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
   p->pid = 0;
+  asidfree(p->ctxid);
   p->ctxid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->nzfod = 0;
+  p->nzero = 0;
+  p->ncow = 0;
+  p->nfilein = 0;
+  p->nhuge = 0;
+  p->nfpload = 0;
   p->state = UNUSED;
 }
 
@@ -195,12 +268,14 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p, 0);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growing only reserves the address range; pages are
+// allocated on first touch by uvmfault().
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -210,9 +285,9 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz + n < sz)
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
@@ -235,15 +310,22 @@ fork(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, 0, p->sz, 0) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  if(mmapcopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
+  fpflush(p);
+  np->fp = p->fp;
 
   // Cause fork to return 0 in the child.
   np->trapframe->x0 = 0;
@@ -253,6 +335,7 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  vmadup(np->vma, p->vma);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -265,7 +348,70 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np, 0);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a process running the program path with arguments
+// argv, as fork() and then exec() in the child would, but
+// without copying the caller's memory only to throw it away.
+// If fds is not 0, the child's file descriptors 0..NSPAWNFD-1
+// are the caller's fds[0..NSPAWNFD-1] (-1 for none), and it
+// gets no others; otherwise it gets all of the caller's.
+// Returns the child's pid, or -1 if path cannot be run.
+int
+spawn(char *path, char **argv, int *fds)
+{
+  int i, argc, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if(fds){
+    for(i = 0; i < NSPAWNFD; i++){
+      if(fds[i] < -1 || fds[i] >= NOFILE || (fds[i] >= 0 && p->ofile[fds[i]] == 0))
+        return -1;
+    }
+  }
+
+  // Allocate process.
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  // exec() sleeps. np is USED, so the scheduler and wait()
+  // leave it alone meanwhile.
+  release(&np->lock);
+
+  // Load the program straight into np's empty image.
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = exec(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->x0 = argc;
+
+  if(fds){
+    for(i = 0; i < NSPAWNFD; i++)
+      if(fds[i] >= 0)
+        np->ofile[i] = filedup(p->ofile[fds[i]]);
+  } else {
+    for(i = 0; i < NOFILE; i++)
+      if(p->ofile[i])
+        np->ofile[i] = filedup(p->ofile[i]);
+  }
+  np->cwd = idup(p->cwd);
+
+  pid = np->pid;
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np, 0);
   release(&np->lock);
 
   return pid;
@@ -306,8 +452,12 @@ exit(int status)
     }
   }
 
+  // write back MAP_SHARED memory; freeproc() must not sleep.
+  mmapfree(p);
+
   begin_op();
   iput(p->cwd);
+  vmaput(p->vma);
   end_op();
   p->cwd = 0;
 
@@ -380,10 +530,270 @@ wait(uint64 addr)
   }
 }
 
+// A process has been queued for CPU cpu: if cpu is idle,
+// wake it up; otherwise wake some other idle CPU, if any,
+// to steal the process.
+static void
+kick(int cpu)
+{
+  int i;
+
+  if(runqs[cpu].idle){
+    gic_send_sgi(cpu, IPI_WAKE);
+    return;
+  }
+  for(i = 0; i < NCPU; i++){
+    if(i != cpuid() && runqs[i].idle){
+      gic_send_sgi(i, IPI_WAKE);
+      return;
+    }
+  }
+}
+
+// Append p to CPU cpu's run queue. A process that yields
+// back onto its own CPU's queue is run again by that CPU,
+// so no other is woken for it.
+static void
+rqpush(int cpu, struct proc *p, int yielding)
+{
+  struct runq *rq = &runqs[cpu];
+
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if(rq->tail)
+    rq->tail->rqnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  if(++rq->n > rq->maxn)
+    rq->maxn = rq->n;
+  release(&rq->lock);
+
+  if(yielding && cpu == cpuid())
+    return;
+  // pairs with the barrier in idle().
+  __sync_synchronize();
+  kick(cpu);
+}
+
+// Take the process at the head of CPU cpu's run queue,
+// or return 0 if it is empty.
+static struct proc*
+rqpop(int cpu)
+{
+  struct runq *rq = &runqs[cpu];
+  struct proc *p;
+
+  acquire(&rq->lock);
+  if((p = rq->head) != 0){
+    rq->head = p->rqnext;
+    if(rq->head == 0)
+      rq->tail = 0;
+    rq->n--;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Choose the run queue for p, which is becoming RUNNABLE.
+// A process that has run before goes back to the CPU it last
+// ran on, whose caches may still hold its memory, unless that
+// CPU has more than one process queued beyond the current
+// CPU's. A new process goes to the shortest queue.
+// The lengths are read without locks; they only steer.
+static int
+rqchoose(struct proc *p)
+{
+  int me = cpuid(), best, i;
+
+  if(p->lastcpu >= 0){
+    if(p->lastcpu == me || runqs[p->lastcpu].n <= runqs[me].n + 1)
+      return p->lastcpu;
+    return me;
+  }
+  best = me;
+  for(i = 0; i < NCPU; i++){
+    if(runqs[i].online && runqs[i].n < runqs[best].n)
+      best = i;
+  }
+  return best;
+}
+
+// Make p RUNNABLE and queue it to run; yielding if p is
+// the current process giving up the CPU.
+// p->lock must be held.
+static void
+setrunnable(struct proc *p, int yielding)
+{
+  p->state = RUNNABLE;
+  p->readyat = r_cntvct_el0();
+  rqpush(rqchoose(p), p, yielding);
+}
+
+// For CPU me, whose queue is empty: take the process at
+// the head of the longest other queue, the one that has
+// waited there longest. Returns 0 if all are empty.
+static struct proc*
+steal(int me)
+{
+  struct proc *p;
+  int i, victim = -1;
+
+  for(i = 0; i < NCPU; i++){
+    if(i != me && runqs[i].n > 0 && (victim < 0 || runqs[i].n > runqs[victim].n))
+      victim = i;
+  }
+  if(victim < 0 || (p = rqpop(victim)) == 0)
+    return 0;
+  runqs[me].nsteal++;
+  return p;
+}
+
+// Nothing to run on CPU me: wait for an interrupt instead of
+// spinning, with the timer set only for the next sleeping
+// process's deadline. The CPU that queues a process for this
+// one, or that would have it steal one, interrupts it (see
+// kick()).
+static void
+idle(int me)
+{
+  struct runq *rq = &runqs[me];
+  int i;
+
+  // with interrupts off, one that arrives after the check
+  // stays pending, and wfi returns at once.
+  intr_off();
+  rq->idle = 1;
+  __sync_synchronize();
+  for(i = 0; i < NCPU; i++){
+    if(runqs[i].n > 0)
+      break;
+  }
+  if(i == NCPU){
+    timerarm();
+    wfi();
+    rq->nidle++;
+  }
+  rq->idle = 0;
+  intr_on();
+}
+
+// The latency histogram bucket for a wait of c counter
+// increments: c itself below 8, and above that one of 8
+// buckets per power of two, so that the waits in a bucket
+// are within 1/8 of each other.
+static int
+latbucket(uint64 c)
+{
+  int b;
+
+  if(c < 8)
+    return c;
+  if(c > 0xffffffff)
+    c = 0xffffffff;
+  b = 63 - __builtin_clzl(c);   // top bit, 3..31
+  return (b-2)*8 + ((c >> (b-3)) & 7);
+}
+
+// The longest wait in bucket i.
+static uint64
+latbucketmax(int i)
+{
+  if(i < 8)
+    return i;
+  return ((uint64)(8 + i%8 + 1) << (i/8 - 1)) - 1;
+}
+
+static void
+latrecord(struct runq *rq, uint64 c)
+{
+  rq->lat[latbucket(c)]++;
+  if(c > rq->latmax)
+    rq->latmax = c;
+}
+
+// Sum the CPUs' latency histograms into *sl.
+static void
+latread(struct schedlat *sl)
+{
+  static int pct[] = { 500, 900, 990, 999 };  // per mille
+  uint64 *val[] = { &sl->p50, &sl->p90, &sl->p99, &sl->p999 };
+  uint64 sum;
+  int i, b, k;
+
+  memset(sl, 0, sizeof(*sl));
+  for(i = 0; i < NCPU; i++){
+    for(b = 0; b < NLAT; b++)
+      sl->n += runqs[i].lat[b];
+    if(runqs[i].latmax > sl->max)
+      sl->max = runqs[i].latmax;
+  }
+  sum = 0;
+  k = 0;
+  for(b = 0; b < NLAT && k < NELEM(pct); b++){
+    for(i = 0; i < NCPU; i++)
+      sum += runqs[i].lat[b];
+    for(; k < NELEM(pct) && sum * 1000 >= sl->n * pct[k] && sum > 0; k++)
+      *val[k] = timerclkns(latbucketmax(b)) / 1000;
+  }
+  sl->max = timerclkns(sl->max) / 1000;
+}
+
+// Tune the scheduler or measure it; see sched.h.
+// Returns the old time for SCHED_TICK, SCHED_SLICE and
+// SCHED_DEFSLICE, 0 for the others, or -1 on error.
+int
+schedctl(int op, uint64 arg)
+{
+  struct proc *p = myproc();
+  struct schedlat sl;
+  int i, old;
+
+  switch(op){
+  case SCHED_TICK:
+    if(arg > 1000000)
+      return -1;
+    return timersettick(arg);
+  case SCHED_SLICE:
+  case SCHED_DEFSLICE:
+    if(arg != 0 && (arg < SLICEMINUS || arg > 1000000))
+      return -1;
+    if(op == SCHED_DEFSLICE){
+      old = slicedef;
+      if(arg != 0)
+        slicedef = arg;
+    } else {
+      acquire(&p->lock);
+      old = p->slice;
+      if(arg != 0)
+        p->slice = arg;
+      release(&p->lock);
+    }
+    return old;
+  case SCHED_LATSTART:
+    latmeasure = 0;
+    for(i = 0; i < NCPU; i++){
+      memset(runqs[i].lat, 0, sizeof(runqs[i].lat));
+      runqs[i].latmax = 0;
+    }
+    __sync_synchronize();
+    latmeasure = 1;
+    return 0;
+  case SCHED_LATSTOP:
+    latmeasure = 0;
+    return 0;
+  case SCHED_LATREAD:
+    latread(&sl);
+    return copyout(p->pagetable, arg, (char *)&sl, sizeof(sl));
+  }
+  return -1;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run: the next on this CPU's
+//    run queue, or else one stolen from another CPU's.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -392,38 +802,50 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int me = cpuid();
+  struct runq *rq = &runqs[me];
 
   c->proc = 0;
+  rq->online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        if(!p->ctxid)
-          p->ctxid = asid_gen++;
-
-        switchuvm(p);
-
-        for(uint64 i = 0; i < p->sz; i += PGSIZE)
-          cpu_sync_cache((void *)i, PGSIZE);
-
-        swtch(&c->context, &p->context);
-
-        switchkvm();
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+    if((p = rqpop(me)) == 0 && (p = steal(me)) == 0){
+      // nothing to run; zero pages for kalloc_zeroed(),
+      // or else sleep until there is something to do.
+      if(kzerofill() == 0)
+        idle(me);
+      continue;
     }
+
+    // the CPU that queued p may still be switching away
+    // from it; p->lock is held until it has.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: queued process not runnable");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->lastcpu = me;
+    c->proc = p;
+    rq->nrun++;
+    if(latmeasure)
+      latrecord(rq, r_cntvct_el0() - p->readyat);
+    switchuvm(p);
+    timerslice(p->slice);
+
+    swtch(&c->context, &p->context);
+
+    timerslice(0);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -450,6 +872,7 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
+  fpswitch(p);
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
@@ -460,7 +883,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p, 1);
   sched();
   release(&p->lock);
 }
@@ -488,26 +911,67 @@ forkret(void)
   usertrapret(tf);
 }
 
+static struct waitq*
+waitq(void *chan)
+{
+  return &waitqs[((uint64)chan >> 3) % NWAITQ];
+}
+
+// Append p to wq. wq->lock must be held.
+static void
+wqlink(struct waitq *wq, struct proc *p)
+{
+  p->wqnext = 0;
+  p->wqprev = wq->tail;
+  if(wq->tail)
+    wq->tail->wqnext = p;
+  else
+    wq->head = p;
+  wq->tail = p;
+  p->onwaitq = 1;
+}
+
+// Remove p from wq. wq->lock must be held.
+static void
+wqunlink(struct waitq *wq, struct proc *p)
+{
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    wq->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  else
+    wq->tail = p->wqprev;
+  p->onwaitq = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = waitq(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once p is on chan's wait queue, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup looks there, then waits for p->lock
+  // before making p RUNNABLE),
   // so it's okay to release lk.
 
   acquire(&p->lock);  //DOC: sleeplock1
-  release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  acquire(&wq->lock);
+  wqlink(wq, p);
+  release(&wq->lock);
+
+  release(lk);
 
   sched();
 
@@ -519,22 +983,57 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// Make RUNNABLE the processes sleeping on chan, or only
+// the one that has slept longest if one is set.
+static void
+wake(void *chan, int one)
+{
+  struct waitq *wq = waitq(chan);
+  struct proc *p, *next, *woken = 0, **tail = &woken;
+
+  acquire(&wq->lock);
+  for(p = wq->head; p != 0; p = next){
+    next = p->wqnext;
+    if(p->chan == chan){
+      wqunlink(wq, p);
+      p->wqnext = 0;
+      *tail = p;
+      tail = &p->wqnext;
+      if(one)
+        break;
+    }
+  }
+  release(&wq->lock);
+
+  // each holds its p->lock from before it was linked
+  // until it has switched away in sched().
+  for(p = woken; p != 0; p = next){
+    next = p->wqnext;
+    acquire(&p->lock);
+    if(p->state != SLEEPING)
+      panic("wakeup");
+    setrunnable(p, 0);
+    release(&p->lock);
+  }
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wake(chan, 0);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-    }
-  }
+// Wake up the process that has slept longest on chan, for
+// channels where only one waiter can go on, like a sleeplock
+// being released; waking the rest would only send them
+// back to sleep.
+// Must be called without any p->lock.
+void
+wakeup_one(void *chan)
+{
+  wake(chan, 1);
 }
 
 // Kill the process with the given pid.
@@ -550,8 +1049,16 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
+        // Wake process from sleep(), unless a wakeup()
+        // has already taken it off its queue and will.
+        struct waitq *wq = waitq(p->chan);
+        int linked;
+        acquire(&wq->lock);
+        if((linked = p->onwaitq) != 0)
+          wqunlink(wq, p);
+        release(&wq->lock);
+        if(linked)
+          setrunnable(p, 0);
       }
       release(&p->lock);
       return 0;
@@ -616,6 +1123,44 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    printf(" faults: zfod %d zero %d cow %d filein %d", p->nzfod, p->nzero, p->ncow, p->nfilein);
+    // share of zero-fill faults that got a whole 2MB block.
+    if(p->nhuge > 0)
+      printf(" huge %d (%d%%)", p->nhuge, 100 * p->nhuge / (p->nhuge + p->nzfod));
+    if(p->nfpload > 0)
+      printf(" fp %d", p->nfpload);
     printf("\n");
   }
+  for(int i = 0; i < NCPU; i++){
+    if(runqs[i].online)
+      printf("cpu%d: runq %d (max %d), ran %d, stole %d, idled %d\n", i,
+             runqs[i].n, runqs[i].maxn, runqs[i].nrun, runqs[i].nsteal, runqs[i].nidle);
+  }
+}
+
+// Copy the file-backed memory regions of a process
+// to another, taking new references to their files.
+void
+vmadup(struct vma *dst, struct vma *src)
+{
+  for(int i = 0; i < NVMA; i++){
+    dst[i] = src[i];
+    if(src[i].ip)
+      dst[i].ip = idup(src[i].ip);
+  }
+}
+
+// Release the files behind an array of NVMA memory
+// regions. The regions themselves stay; exec() replaces
+// them and freeproc() clears them.
+// Must be called inside a transaction.
+void
+vmaput(struct vma *vma)
+{
+  for(int i = 0; i < NVMA; i++){
+    if(vma[i].ip){
+      iput(vma[i].ip);
+      vma[i].ip = 0;
+    }
+  }
 }
@@ -24,6 +24,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  struct proc *fpowner;       // Process whose FP/SIMD registers are loaded.
+  uint64 sliceend;            // Counter value at which proc's time slice ends, or 0.
 };
 
 extern struct cpu cpus[NCPU];
@@ -78,9 +80,28 @@ struct trapframe {
   uint64 sp;     
 };
 
+// FP/SIMD registers of a user process; see fpsimd.c.
+struct fpsimd {
+  uint64 v[64];                // v0-v31, 128 bits each
+  uint64 fpcr;
+  uint64 fpsr;
+} __attribute__((aligned(16)));
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A region of user memory that is filled in on first touch:
+// an ELF segment paged in from a file by exec(), or a region
+// made by mmap(). The slot is unused if end is zero.
+struct vma {
+  uint64 start;                // first virtual address, page-aligned
+  uint64 end;                  // one past the last virtual address
+  int prot;                    // PROT_ bits (fcntl.h)
+  int flags;                   // MAP_ bits for mmap() regions, 0 for exec()'s
+  struct inode *ip;            // backing file, or 0 for zero-filled memory
+  uint off;                    // file offset of start
+  uint filesz;                 // bytes backed by the file; the rest is zero
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -91,7 +112,16 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
-  int ctxid;
+  uint64 ctxid;                // ASID and its generation; see switchuvm()
+  struct proc *rqnext;         // Next on a run queue, while RUNNABLE
+  int lastcpu;                 // CPU p last ran on, or -1
+  uint64 readyat;              // Counter value when p became RUNNABLE
+  uint slice;                  // Time slice, in microseconds
+
+  // chan's wait queue lock must be held when using these:
+  struct proc *wqnext;         // Next and previous on a wait queue
+  struct proc *wqprev;
+  int onwaitq;                 // Linked on chan's wait queue
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -104,5 +134,16 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct vma vma[NVMA];        // File-backed memory regions
   char name[16];               // Process name (debugging)
+  struct fpsimd fp;            // FP/SIMD registers, when not loaded
+  int fpcpu;                   // CPU whose FP/SIMD unit may hold them, or -1
+
+  // page faults taken, for procdump().
+  int nzfod;                   // pages zero-filled on demand
+  int nzero;                   // pages first read, so given the zero page
+  int ncow;                    // copy-on-write copies
+  int nfilein;                 // pages read in from a file
+  int nhuge;                   // 2MB blocks zero-filled on demand
+  int nfpload;                 // FP/SIMD registers loaded after a trap
 };
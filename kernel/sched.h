@@ -0,0 +1,19 @@
+// schedctl() operations. Times are in microseconds; a time
+// of 0 only returns the current one.
+#define SCHED_TICK      1   // set the clock tick, the unit of sleep() and uptime()
+#define SCHED_SLICE     2   // set the calling process's time slice
+#define SCHED_DEFSLICE  3   // set the time slice new processes get
+#define SCHED_LATSTART  4   // start measuring scheduling latency afresh
+#define SCHED_LATSTOP   5   // stop measuring it
+#define SCHED_LATREAD   6   // fill in the struct schedlat at arg
+
+// scheduling latency: how long processes waited to run after
+// they became RUNNABLE, in microseconds, to within 1/8.
+struct schedlat {
+  uint64 n;         // times a process was switched to
+  uint64 p50;       // percentiles
+  uint64 p90;
+  uint64 p99;
+  uint64 p999;
+  uint64 max;
+};
@@ -1,61 +1,10 @@
 #include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "aarch64.h"
+#include "defs.h"
 
-void*
-memset(void *dst, int c, uint n)
-{
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
-  }
-  return dst;
-}
-
-int
-memcmp(const void *v1, const void *v2, uint n)
-{
-  const uchar *s1, *s2;
-
-  s1 = v1;
-  s2 = v2;
-  while(n-- > 0){
-    if(*s1 != *s2)
-      return *s1 - *s2;
-    s1++, s2++;
-  }
-
-  return 0;
-}
-
-void*
-memmove(void *dst, const void *src, uint n)
-{
-  const char *s;
-  char *d;
-
-  if(n == 0)
-    return dst;
-  
-  s = src;
-  d = dst;
-  if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
-
-  return dst;
-}
-
-// memcpy exists to placate GCC.  Use memmove.
-void*
-memcpy(void *dst, const void *src, uint n)
-{
-  return memmove(dst, src, n);
-}
+// memset(), memmove(), memcpy() and memcmp() are in mem.S.
 
 int
 strncmp(const char *p, const char *q, uint n)
@@ -105,3 +54,108 @@ strlen(const char *s)
   return n;
 }
 
+
+// Byte-at-a-time checks of the mem.S routines on a page
+// filled with a pattern.
+static void
+memfill(char *p, int seed)
+{
+  for(int i = 0; i < PGSIZE; i++)
+    p[i] = i * 7 + seed;
+}
+
+static int
+memis(char *p, int seed, int from, int to)
+{
+  for(int i = from; i < to; i++){
+    if(p[i] != (char)(i * 7 + seed))
+      return 0;
+  }
+  return 1;
+}
+
+// Check memset(), memmove() and memcmp() at assorted alignments
+// and over the lengths where they change strategy, and print
+// how fast memset() and memmove() go through a page.
+// Called at boot, once kalloc() works.
+void
+memtest(void)
+{
+  static uint lens[] = { 0, 1, 7, 8, 15, 16, 17, 31, 63, 64, 65,
+                         127, 255, 256, 257, 1000, 2048, 3000 };
+  static int aligns[] = { 0, 1, 4, 7, 8, 9, 15 };
+  char *a, *b;
+  uint n;
+  int i, j, jd, off, doff, k, c;
+  uint64 t0, t1, t2;
+
+  if((a = kalloc()) == 0 || (b = kalloc()) == 0)
+    panic("memtest: kalloc");
+
+  for(j = 0; j < NELEM(aligns); j++){
+    off = aligns[j];
+    for(i = 0; i < NELEM(lens); i++){
+      n = lens[i];
+
+      // memset, zero (dc zva) and not.
+      for(c = 0; c < 0x200; c += 0x15a){
+        memfill(a, 1);
+        if(memset(a + 64 + off, c, n) != a + 64 + off)
+          panic("memset: return");
+        for(k = 0; k < n; k++)
+          if(a[64 + off + k] != (char)c)
+            panic("memset");
+        if(!memis(a, 1, 0, 64 + off) || !memis(a, 1, 64 + off + n, PGSIZE))
+          panic("memset: outside");
+      }
+
+      for(jd = 0; jd < NELEM(aligns); jd++){
+        doff = aligns[jd];
+        // apart.
+        memfill(a, 2);
+        memfill(b, 3);
+        if(memmove(b + 32 + doff, a + 16 + off, n) != b + 32 + doff)
+          panic("memmove: return");
+        for(k = 0; k < n; k++)
+          if(b[32 + doff + k] != (char)((16 + off + k) * 7 + 2))
+            panic("memmove");
+        if(!memis(b, 3, 0, 32 + doff) || !memis(b, 3, 32 + doff + n, PGSIZE))
+          panic("memmove: outside");
+        if(memcmp(b + 32 + doff, a + 16 + off, n) != 0)
+          panic("memcmp: equal");
+        if(n > 0){
+          k = (n * 5) / 8;
+          b[32 + doff + k] ^= 0x80;
+          if((memcmp(b + 32 + doff, a + 16 + off, n) < 0) != ((uchar)b[32 + doff + k] < (uchar)a[16 + off + k]))
+            panic("memcmp: order");
+        }
+
+        // overlapping, dst above and below src.
+        memfill(a, 4);
+        memmove(a + 40 + doff, a + 8 + off, n);
+        for(k = 0; k < n; k++)
+          if(a[40 + doff + k] != (char)((8 + off + k) * 7 + 4))
+            panic("memmove: overlap up");
+        memfill(a, 5);
+        memmove(a + 8 + off, a + 40 + doff, n);
+        for(k = 0; k < n; k++)
+          if(a[8 + off + k] != (char)((40 + doff + k) * 7 + 5))
+            panic("memmove: overlap down");
+      }
+    }
+  }
+
+  t0 = r_cntvct_el0();
+  for(i = 0; i < 256; i++)
+    memset(a, 0, PGSIZE);
+  t1 = r_cntvct_el0();
+  for(i = 0; i < 256; i++)
+    memmove(b, a, PGSIZE);
+  t2 = r_cntvct_el0();
+  printf("memset %d MB/s, memmove %d MB/s\n",
+         (int)(256UL * PGSIZE * r_cntfrq_el0() / (t1 - t0 + 1) >> 20),
+         (int)(256UL * PGSIZE * r_cntfrq_el0() / (t2 - t1 + 1) >> 20));
+
+  kfree(a);
+  kfree(b);
+}
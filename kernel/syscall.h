@@ -20,3 +20,11 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_mprotect 24
+#define SYS_msync  25
+#define SYS_spawn  26
+#define SYS_nanosleep 27
+#define SYS_clock_gettime 28
+#define SYS_schedctl 29
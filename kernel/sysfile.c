@@ -75,6 +75,9 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
+  // pipes, the console and readi() copy out with locks held.
+  if(n > 0)
+    uvmprefault(myproc(), p, n);
   return fileread(f, p, n);
 }
 
@@ -87,6 +90,9 @@ sys_write(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
+  // pipes, the console and writei() copy in with locks held.
+  if(n > 0)
+    uvmprefault(myproc(), p, n);
 
   return filewrite(f, p, n);
 }
@@ -412,46 +418,74 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the user's null-terminated array of argument
+// strings at uargv into argv[MAXARG], a page per string.
+// Returns 0 on success, -1 on error; either way, the caller
+// must give the pages back with freeargv().
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
+  uint64 uarg;
   int i;
-  uint64 uargv, uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
-    }
-    if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
-    }
+    if(i >= MAXARG)
+      return -1;
+    if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0)
+      return -1;
     if(uarg == 0){
       argv[i] = 0;
-      break;
+      return 0;
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+}
 
-  int ret = exec(path, argv);
-
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+static void
+freeargv(char **argv)
+{
+  for(int i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
 
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret = -1;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(myproc(), path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  int fds[NSPAWNFD];
+  uint64 uargv, ufds;
+  int ret = -1;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 || argaddr(2, &ufds) < 0){
+    return -1;
+  }
+  if(ufds && copyin(myproc()->pagetable, (char*)fds, ufds, sizeof(fds)) < 0)
+    return -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = spawn(path, argv, ufds ? fds : 0);
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -35,6 +35,9 @@ sys_wait(void)
   uint64 p;
   if(argaddr(0, &p) < 0)
     return -1;
+  // wait() copies out the status with locks held.
+  if(p != 0)
+    uvmprefault(myproc(), p, sizeof(int));
   return wait(p);
 }
 
@@ -52,25 +55,108 @@ sys_sbrk(void)
   return addr;
 }
 
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len, off;
+  int prot, flags, fd;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argaddr(5, &off) < 0)
+    return -1;
+  return mmap(addr, len, prot, flags, fd, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+uint64
+sys_mprotect(void)
+{
+  uint64 addr, len;
+  int prot;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0 || argint(2, &prot) < 0)
+    return -1;
+  return mprotect(addr, len, prot);
+}
+
+uint64
+sys_msync(void)
+{
+  uint64 addr, len;
+  int flags;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0 || argint(2, &flags) < 0)
+    return -1;
+  return msync(addr, len, flags);
+}
+
 uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
+  if(n <= 0)
+    return 0;
+  return timersleep(timerafterticks(n));
+}
+
+// sleep for the time in *req, to the counter's precision.
+// if the process is killed first, return -1 with the time
+// that was left in *rem, unless rem is 0.
+uint64
+sys_nanosleep(void)
+{
+  struct proc *p = myproc();
+  struct timespec ts;
+  uint64 req, rem, when;
+
+  if(argaddr(0, &req) < 0 || argaddr(1, &rem) < 0)
+    return -1;
+  if(copyin(p->pagetable, (char *)&ts, req, sizeof(ts)) < 0)
+    return -1;
+  if(ts.tv_nsec >= 1000000000)
+    return -1;
+  if(ts.tv_sec > 0xffffffff)    // about 136 years
+    ts.tv_sec = 0xffffffff;
+  when = timerafter(ts.tv_sec * 1000000000 + ts.tv_nsec);
+  if(timersleep(when) == 0)
+    return 0;
+  if(rem != 0){
+    when = timerleft(when);
+    ts.tv_sec = when / 1000000000;
+    ts.tv_nsec = when % 1000000000;
+    copyout(p->pagetable, rem, (char *)&ts, sizeof(ts));
   }
-  release(&tickslock);
-  return 0;
+  return -1;
+}
+
+// store the time since boot in *tp.
+uint64
+sys_clock_gettime(void)
+{
+  struct timespec ts;
+  uint64 tp, ns;
+  int clk;
+
+  if(argint(0, &clk) < 0 || argaddr(1, &tp) < 0)
+    return -1;
+  if(clk != CLOCK_MONOTONIC)
+    return -1;
+  ns = timerns();
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  return copyout(myproc()->pagetable, tp, (char *)&ts, sizeof(ts));
 }
 
 uint64
@@ -83,15 +169,21 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
+// return how many clock ticks have passed
 // since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return timerticks();
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+uint64
+sys_schedctl(void)
+{
+  int op;
+  uint64 arg;
+
+  if(argint(0, &op) < 0 || argaddr(1, &arg) < 0)
+    return -1;
+  return schedctl(op, arg);
 }
@@ -2,24 +2,75 @@
 #include "param.h"
 #include "memlayout.h"
 #include "aarch64.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 
 // armv8 generic timer driver
+//
+// Time is the system counter, which all CPUs share. Ticks,
+// the unit of sleep() and uptime(), are counted from it and
+// need no interrupts; their length can be changed while
+// running with timersettick(). Processes sleep until a
+// counter value with timersleep(), which keeps them in a heap
+// ordered by deadline. Each CPU programs its timer
+// (CNTV_CVAL) one-shot, for the earliest deadline or the end
+// of the running process's time slice, whichever comes first,
+// or not at all if there is neither (see timerarm()).
 
 #define CNTV_CTL_ENABLE   (1<<0)
 #define CNTV_CTL_IMASK    (1<<1)
 #define CNTV_CTL_ISTATUS  (1<<2)
 
+static uint64 boot;       // counter value at boot
+static uint64 freq;       // counter increments per second
+
+// a process sleeping in timersleep().
+struct timer {
+  uint64 when;            // counter value to wake up at
+  int fired;              // when has passed
+};
+
+// pending timers, a binary heap with the earliest first.
+// each process has at most one.
+struct {
+  struct spinlock lock;
+  struct timer *heap[NPROC];
+  int n;
+  volatile uint64 next;   // heap[0]->when, or 0; read without lock
+
+  // ticks since boot are tickbase + (counter - tickstart) / tickclk.
+  uint tickus;            // microseconds per tick
+  uint64 tickclk;         // counter increments per tick
+  uint64 tickstart;
+  uint tickbase;
+} timers;
+
 static void enable_timer(void);
 static void disable_timer(void);
-static void reload_timer(void);
+
+// counter increments in us microseconds, us at most 1000000.
+static uint64
+usclk(uint64 us)
+{
+  return us * freq / 1000000;
+}
 
 void
 timerinit()
 {
+  if(cpuid() == 0){
+    initlock(&timers.lock, "timers");
+    freq = r_cntfrq_el0();
+    boot = r_cntvct_el0();
+    timers.tickus = TICKUS;
+    timers.tickclk = usclk(TICKUS);
+    if(timers.tickclk == 0)
+      panic("timerinit: tick");
+    timers.tickstart = boot;
+    __sync_synchronize();
+  }
   disable_timer();
-  reload_timer();
-  enable_timer();
 }
 
 static void
@@ -40,20 +91,233 @@ disable_timer()
   w_cntv_ctl_el0(c);
 }
 
+// ticks since boot, from the counter.
+uint
+timerticks(void)
+{
+  uint t;
+
+  acquire(&timers.lock);
+  t = timers.tickbase + (r_cntvct_el0() - timers.tickstart) / timers.tickclk;
+  release(&timers.lock);
+  return t;
+}
+
+// Make a tick us microseconds long from now on; ticks so far
+// are kept. Returns the old length, or -1 if us is out of
+// range. us 0 only returns the length.
+int
+timersettick(uint us)
+{
+  uint64 now;
+  int old;
+
+  if(us != 0 && (us < TICKMINUS || us > 1000000 || usclk(us) == 0))
+    return -1;
+  acquire(&timers.lock);
+  old = timers.tickus;
+  if(us != 0){
+    now = r_cntvct_el0();
+    timers.tickbase += (now - timers.tickstart) / timers.tickclk;
+    timers.tickstart = now;
+    timers.tickus = us;
+    timers.tickclk = usclk(us);
+  }
+  release(&timers.lock);
+  return old;
+}
+
+// nanoseconds since boot.
+uint64
+timerns(void)
+{
+  return timerclkns(r_cntvct_el0() - boot);
+}
+
+// counter value ns nanoseconds from now.
+uint64
+timerafter(uint64 ns)
+{
+  return r_cntvct_el0() + ns / 1000000000 * freq + ns % 1000000000 * freq / 1000000000;
+}
+
+// counter value ticks ticks from now.
+uint64
+timerafterticks(uint n)
+{
+  return r_cntvct_el0() + n * timers.tickclk;
+}
+
+// nanoseconds until counter value when, or 0 if it has passed.
+uint64
+timerleft(uint64 when)
+{
+  uint64 now = r_cntvct_el0();
+
+  if(when <= now)
+    return 0;
+  return timerclkns(when - now);
+}
+
+// nanoseconds in c counter increments.
+uint64
+timerclkns(uint64 c)
+{
+  return c / freq * 1000000000 + c % freq * 1000000000 / freq;
+}
+
 static void
-reload_timer()
+swap(int i, int j)
 {
-  // interval 100ms
-  uint64 interval = 100000;
-  uint64 interval_clk = interval * (r_cntfrq_el0() / 1000000);
+  struct timer *t = timers.heap[i];
+  timers.heap[i] = timers.heap[j];
+  timers.heap[j] = t;
+}
 
-  w_cntv_tval_el0(interval_clk);
+// move heap[i] up or down to where it belongs.
+static void
+fix(int i)
+{
+  int c;
+
+  while(i > 0 && timers.heap[i]->when < timers.heap[(i-1)/2]->when){
+    swap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  while((c = 2*i + 1) < timers.n){
+    if(c + 1 < timers.n && timers.heap[c+1]->when < timers.heap[c]->when)
+      c++;
+    if(timers.heap[i]->when <= timers.heap[c]->when)
+      break;
+    swap(i, c);
+    i = c;
+  }
+}
+
+static void
+timerdel(struct timer *t)
+{
+  int i;
+
+  for(i = 0; i < timers.n; i++){
+    if(timers.heap[i] == t){
+      timers.heap[i] = timers.heap[--timers.n];
+      if(i < timers.n)
+        fix(i);
+      timers.next = timers.n > 0 ? timers.heap[0]->when : 0;
+      return;
+    }
+  }
+}
+
+// Interrupt this CPU at the earliest timer deadline or the
+// end of its time slice, whichever comes first. A slice that
+// has ended is left to the yield() that is on its way.
+void
+timerarm(void)
+{
+  struct cpu *c;
+  uint64 when, end;
+
+  push_off();   // stay on this CPU
+  c = mycpu();
+  when = timers.next;
+  end = c->sliceend;
+  if(end != 0 && end > r_cntvct_el0() && (when == 0 || end < when))
+    when = end;
+  if(when == 0){
+    disable_timer();
+  } else {
+    w_cntv_cval_el0(when);
+    enable_timer();
+  }
+  pop_off();
+}
+
+// Start a time slice of us microseconds for the process
+// this CPU is switching to, or end the slice if us is 0.
+void
+timerslice(uint us)
+{
+  struct cpu *c;
+
+  push_off();
+  c = mycpu();
+  c->sliceend = us == 0 ? 0 : r_cntvct_el0() + usclk(us);
+  if(us != 0)
+    timerarm();
+  pop_off();
+}
+
+// Has the running process's time slice ended?
+int
+timersliceover(void)
+{
+  struct cpu *c;
+  int over;
+
+  push_off();
+  c = mycpu();
+  over = c->sliceend != 0 && r_cntvct_el0() >= c->sliceend;
+  pop_off();
+  return over;
+}
+
+// Sleep until the counter reaches when.
+// Returns 0, or -1 if the process was killed first.
+int
+timersleep(uint64 when)
+{
+  struct timer t;
+
+  t.when = when;
+  t.fired = 0;
+  acquire(&timers.lock);
+  if(timers.n == NPROC)
+    panic("timersleep");
+  timers.heap[timers.n++] = &t;
+  fix(timers.n - 1);
+  timers.next = timers.heap[0]->when;
+  release(&timers.lock);
+  // the deadline may be sooner than this CPU's timer.
+  timerarm();
+
+  acquire(&timers.lock);
+  while(!t.fired){
+    if(myproc()->killed){
+      timerdel(&t);
+      release(&timers.lock);
+      return -1;
+    }
+    sleep(&t, &timers.lock);
+  }
+  release(&timers.lock);
+  return 0;
+}
+
+// wake the processes whose deadlines have passed.
+static void
+timerexpire(void)
+{
+  struct timer *t;
+  uint64 now = r_cntvct_el0();
+
+  acquire(&timers.lock);
+  while(timers.n > 0 && timers.heap[0]->when <= now){
+    t = timers.heap[0];
+    timers.heap[0] = timers.heap[--timers.n];
+    if(timers.n > 0)
+      fix(0);
+    t->fired = 1;
+    wakeup(t);
+  }
+  timers.next = timers.n > 0 ? timers.heap[0]->when : 0;
+  release(&timers.lock);
 }
 
 void
 timerintr()
 {
-  disable_timer();
-  reload_timer();
-  enable_timer();
+  timerexpire();
+  timerarm();
 }
@@ -6,20 +6,19 @@
 #include "proc.h"
 #include "defs.h"
 
-struct spinlock tickslock;
-uint ticks;
-
 // in trapvec.S, calls kerneltrap() or usertrap().
 void alltraps();
 void dump_tf(struct trapframe *tf);
 
 extern int devintr();
 
-void
-trapinit(void)
-{
-  initlock(&tickslock, "time");
-}
+// exception table: user accesses in usercopy.S that may fault,
+// and where to resume if they do. kernel.ld collects it.
+struct extable {
+  uint64 insn;
+  uint64 fixup;
+};
+extern struct extable extable_start[], extable_end[];
 
 // set up to take exceptions and traps.
 void
@@ -40,8 +39,8 @@ userirq(void)
   struct proc *p = myproc();
 
   int which_dev = devintr();
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if its time slice has ended.
+  if(which_dev == 2 && timersliceover())
     yield();
 
   if(p->killed)
@@ -55,8 +54,9 @@ usertrap(struct trapframe *tf)
 {
   struct proc *p = myproc();
 
-  uint64 ec = (r_esr_el1() >> 26) & 0x3f;
-  if(ec == 21){
+  uint64 esr = r_esr_el1();
+  uint64 ec = ESR_EC(esr);
+  if(ec == EC_SVC64){
     // system call
     if(p->killed)
       exit(-1);
@@ -64,6 +64,22 @@ usertrap(struct trapframe *tf)
     intr_on();
 
     syscall();
+  } else if(ec == EC_DABT_LOW || ec == EC_IABT_LOW){
+    // page fault: maybe a page to be loaded on demand
+    // or a write to a copy-on-write page.
+    uint64 far = r_far_el1();
+    int write = ec == EC_DABT_LOW && (ESR_ISS(esr) & ISS_WNR);
+
+    intr_on();
+
+    if(uvmfault(p, far, write) < 0){
+      printf("usertrap(): page fault %p ec %p pid=%d\n", far, ec, p->pid);
+      printf("            elr=%p\n", tf->elr);
+      p->killed = 1;
+    }
+  } else if(ec == EC_FP){
+    // the first FP/SIMD instruction since p last got the CPU.
+    fptrap(p);
   } else {
     printf("usertrap(): unexpected ec %p %p pid=%d\n", ec, r_esr_el1(), p->pid);
     printf("            elr=%p far=%p\n", r_elr_el1(), r_far_el1());
@@ -79,15 +95,30 @@ usertrap(struct trapframe *tf)
 // interrupts and exceptions from kernel code go here via kernelvec,
 // on whatever the current kernel stack is.
 void 
-kerneltrap()
+kerneltrap(struct trapframe *tf)
 {
   uint64 esr = r_esr_el1();
+  struct extable *e;
   
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
   uint64 ec = (esr >> 26) & 0x3f;
   uint64 iss = esr & 0x1ffffff;
+
+  if(ec == EC_DABT_CUR){
+    // a copy to or from user memory hit a page that is not
+    // mapped or not accessible: let the copy routine's fixup
+    // report the faulting address to its caller.
+    for(e = extable_start; e < extable_end; e++){
+      if(e->insn == tf->elr){
+        tf->elr = e->fixup;
+        tf->x9 = r_far_el1();
+        return;
+      }
+    }
+  }
+
   printf("esr %p %p %p\n", esr, ec, iss);
   printf("elr=%p far=%p\n", r_elr_el1(), r_far_el1());
   panic("kerneltrap");
@@ -98,20 +129,11 @@ kernelirq()
 {
   int which_dev = devintr();
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if the process's time slice has ended.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && timersliceover())
     yield();
 }
 
-void
-clockintr()
-{
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
-}
-
 // check if it's an external interrupt and handle it.
 // returns 2 if timer interrupt,
 // 1 if other device,
@@ -127,10 +149,11 @@ devintr()
     uartintr();
     dev = 1;
   } else if(irq == TIMER0_IRQ){
-    if(cpuid() == 0)
-      clockintr();
     timerintr();
     dev = 2;
+  } else if(irq == IPI_WAKE){
+    // an idle CPU has been given a process to run.
+    dev = 1;
   } else if(irq == 1023){
     // do nothing
   } else if(irq){
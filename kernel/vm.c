@@ -7,24 +7,93 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "fcntl.h"
 
-uint64 asid_gen = 1;
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+static pte_t *walkleaf(pagetable_t, uint64, int *);
+
+// user memory is mapped with 2MB blocks where it can be.
+#define HUGESIZE  BLKSIZE(2)
+#define HUGEORDER (PXSHIFT(2) - PGSHIFT)   // kalloc_order() of a block
+
+// the first address past the BLKSIZE(level) block holding va.
+#define BLKEND(va, level)  (((va) | (BLKSIZE(level) - 1)) + 1)
+
+// kernel page table mappings of each size, by level:
+// fewer, larger ones need fewer TLB entries.
+static int kvmnmap[4];
 
 /*
  * the kernel's page table.
  */
 pagetable_t kernel_pagetable;
 
+// an empty page table for TTBR0 while no process runs, so
+// that no translations can be cached for user addresses.
+static pagetable_t empty_pagetable;
+
+// a page of zeros, mapped read-only and copy-on-write for
+// anonymous memory that has been read but never written.
+// It holds a reference of its own, so kfree() never frees it.
+static char *zeropage;
+
+// ASIDs tag each process's TLB entries, so that switching
+// page tables needs no TLB flush. p->ctxid holds a generation
+// number above the ASID bits. When a generation runs out of
+// ASIDs, the next one starts with a single TLB flush, and each
+// process takes a new ASID when it next runs. ASIDs running
+// at the time carry over, since their TLB entries are in use:
+// each CPU's is reserved, and the process that owns it keeps
+// it in the new generation.
+// switchuvm() takes asid.lock only to give a process an ASID.
+// Otherwise it just swaps its ctxid into the CPU's active
+// slot, which a rollover clears to make it take the lock.
+struct {
+  struct spinlock lock;
+  int bits;                     // ASID size, 8 or 16
+  uint64 gen;                   // generation << bits; read without lock
+  uint64 map[(1<<16)/64];       // ASIDs in use this generation
+  uint64 next;                  // where to look in map next
+  uint64 active[NCPU];          // ctxid each CPU last switched to, or 0
+  uint64 reserved[NCPU];        // ctxid each CPU carried over, or 0
+  uint nrollover;
+} asid;
+
+#define ASIDMASK  ((1UL << asid.bits) - 1)
+
+#define NTLBFLUSH 32   // pages flushed one by one; more flush the ASID
+
+// A flush set: the pages of a user page table whose TLB entries
+// must go once the page table has been changed. Only the current
+// process's page table can be in a TLB: the others that the
+// kernel changes are either not yet in use (fork's child, exec's
+// new image) or are freed after asidfree() has flushed their
+// ASID, so a flush set for them stays empty.
+struct tlbflush {
+  int live;                 // pagetable is the current process's
+  uint64 asid;
+  int n;                    // pages in va[], or -1 for the whole ASID
+  uint64 va[NTLBFLUSH];
+};
+
+static void tlbbegin(struct tlbflush*, pagetable_t);
+static void tlbadd(struct tlbflush*, uint64);
+static void tlbflush(struct tlbflush*);
+
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 
+extern struct membank membank[];  // kalloc.c
+extern int nmembank;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
 {
   pagetable_t kpgtbl;
+  struct membank *b;
+  uint64 pa;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(kpgtbl, UART(0), V2P(UART(0)), PGSIZE, PTE_DEVICE | PTE_XN);
@@ -39,8 +108,12 @@ kvmmake(void)
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNLINK, V2P(KERNLINK), (uint64)etext-KERNLINK, PTE_NORMAL | PTE_RO);
 
-  // map kernel data and the physical RAM we'll make use of.
-  kvmmap(kpgtbl, (uint64)etext, V2P(etext), (uint64)P2V(PHYSTOP)-(uint64)etext, PTE_NORMAL | PTE_XN);
+  // map kernel data and all the banks of physical RAM.
+  for(b = membank; b < &membank[nmembank]; b++){
+    pa = b->base < V2P(etext) ? V2P(etext) : b->base;
+    if(pa < b->end)
+      kvmmap(kpgtbl, (uint64)P2V(pa), pa, b->end - pa, PTE_NORMAL | PTE_XN);
+  }
 
   return kpgtbl;
 }
@@ -50,6 +123,18 @@ void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  if((empty_pagetable = (pagetable_t)kalloc_zeroed()) == 0)
+    panic("kvminit");
+  if((zeropage = kalloc_zeroed()) == 0)
+    panic("kvminit");
+
+  initlock(&asid.lock, "asid");
+  // TCR_EL1.AS asks for 16-bit ASIDs; it is ignored
+  // on CPUs that only have 8.
+  asid.bits = ((r_id_aa64mmfr0_el1() >> 4) & 0xf) == 2 ? 16 : 8;
+  asid.gen = 1UL << asid.bits;
+  asid.map[0] = 1;   // ASID 0 is empty_pagetable's
+  asid.next = 1;
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -58,7 +143,7 @@ void
 kvminithart()
 {
   w_ttbr1_el1(V2P(kernel_pagetable));
-  w_ttbr0_el1(0);
+  w_ttbr0_el1(V2P(empty_pagetable));
 
   flush_tlb();
 }
@@ -77,22 +162,59 @@ kvminithart()
 //    0..11 -- 12 bits of byte offset within the page.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, 3, alloc);
+}
+
+// Return the address of the level-level PTE for va, which
+// maps a BLKSIZE(level) block (or, at level 3, a page).
+// Creates the tables above it if alloc!=0. Returns 0 if
+// va is inside a block mapped at a higher level.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int level, int alloc)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 1; level < 3; level++) {
-    pte_t *pte = &pagetable[PX(level, va)];
+  for(int l = 1; l < level; l++) {
+    pte_t *pte = &pagetable[PX(l, va)];
     if((*pte & PTE_VALID) && (*pte & PTE_TABLE)) {
       pagetable = (pagetable_t)P2V(PTE2PA(*pte));
+    } else if(*pte & PTE_VALID) {
+      // a block.
+      if(alloc)
+        panic("walk: block");
+      return 0;
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(V2P(pagetable)) | PTE_TABLE | PTE_VALID;
     }
   }
-  return &pagetable[PX(3, va)];
+  return &pagetable[PX(level, va)];
+}
+
+// Return the PTE of the page or block that maps va,
+// and set *level to its level. Returns 0 if va is not mapped,
+// with *level set to that of the invalid PTE, so that a caller
+// walking a range can skip the whole BLKSIZE(*level) it covers.
+static pte_t *
+walkleaf(pagetable_t pagetable, uint64 va, int *level)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    panic("walkleaf");
+
+  for(int l = 1; ; l++){
+    pte = &pagetable[PX(l, va)];
+    *level = l;
+    if((*pte & PTE_VALID) == 0)
+      return 0;
+    if(l == 3 || (*pte & PTE_TABLE) == 0)
+      return pte;
+    pagetable = (pagetable_t)P2V(PTE2PA(*pte));
+  }
 }
 
 // Look up a virtual address, return the physical address,
@@ -103,20 +225,21 @@ walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int level;
 
-  if(va >= MAXVA)
+  if(va >= MAXUVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walkleaf(pagetable, va, &level);
   if(pte == 0)
     return 0;
-  if((*pte & PTE_V) != PTE_V)
-    return 0;
   if((*pte & PTE_AF) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(level != 3)
+    pa += PGROUNDDOWN(va) & (BLKSIZE(level) - 1);
   return pa;
 }
 
@@ -131,24 +254,70 @@ uva2ka(pagetable_t pagetable, uint64 va)
   return (uint64)P2V(pa);
 }
 
-// add a mapping to the kernel page table.
+// add a mapping to the kernel page table, using 1GB and 2MB
+// blocks wherever va and pa are aligned to them, like entry.S.
 // only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, uint64 perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 a, end;
+  pte_t *pte;
+  int level;
+
+  a = PGROUNDDOWN(va);
+  end = PGROUNDUP(va + sz);
+  pa = PGROUNDDOWN(pa);
+  while(a < end){
+    for(level = 1; level < 3; level++){
+      if(a % BLKSIZE(level) == 0 && pa % BLKSIZE(level) == 0 &&
+         end - a >= BLKSIZE(level))
+        break;
+    }
+    if((pte = walklevel(kpgtbl, a, level, 1)) == 0)
+      panic("kvmmap");
+    if(*pte & PTE_VALID)
+      panic("kvmmap: remap");
+    *pte = PA2PTE(pa) | perm | PTE_AF | (level == 3 ? PTE_V : PTE_VALID);
+    kvmnmap[level]++;
+    a += BLKSIZE(level);
+    pa += BLKSIZE(level);
+  }
+}
+
+// Count the pages of kernel page table pagetable.
+static int
+kvmcount(pagetable_t pagetable, int level)
+{
+  int n = 1;
+
+  for(int i = 0; level < 3 && i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_VALID) && (pte & PTE_TABLE))
+      n += kvmcount((pagetable_t)P2V(PTE2PA(pte)), level+1);
+  }
+  return n;
+}
+
+// Print the kernel page table's mappings by size.
+// For debugging; runs when user types ^P on console.
+void
+kvmdump(void)
+{
+  printf("kvm: %d 1GB blocks, %d 2MB blocks, %d pages, %d page-table pages\n",
+         kvmnmap[1], kvmnmap[2], kvmnmap[3], kvmcount(kernel_pagetable, 1));
+  printf("asid: %d bits, %d rollovers\n", asid.bits, asid.nrollover);
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
+// be page-aligned. Parts where va and pa are 2MB-aligned get a
+// 2MB block. Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, uint64 perm)
 {
-  uint64 a, last;
+  uint64 a, last, n;
   pte_t *pte;
 
   if(size == 0)
@@ -157,46 +326,127 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, uint64 perm)
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
-      return -1;
-    if(*pte & PTE_AF)
-      panic("mappages: remap");
-    *pte = PA2PTE(pa) | perm | PTE_AF | PTE_V;
-    if(a == last)
+    if(a % HUGESIZE == 0 && pa % HUGESIZE == 0 && last - a >= HUGESIZE - PGSIZE){
+      if((pte = walklevel(pagetable, a, 2, 1)) == 0)
+        return -1;
+      if(*pte & PTE_VALID)
+        panic("mappages: remap");
+      *pte = PA2PTE(pa) | perm | PTE_AF | PTE_VALID;
+      n = HUGESIZE;
+    } else {
+      if((pte = walk(pagetable, a, 1)) == 0)
+        return -1;
+      if(*pte & PTE_AF)
+        panic("mappages: remap");
+      *pte = PA2PTE(pa) | perm | PTE_AF | PTE_V;
+      n = PGSIZE;
+    }
+    if(a + n > last)
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += n;
+    pa += n;
+  }
+  return 0;
+}
+
+// Split the 2MB block mapped by *pte into 512 pages with the
+// same permissions, mapped by page-table page pt. pt may be one
+// of the block's own pages that the caller is unmapping, in
+// which case that page is left unmapped. The block must not be
+// shared, which uvmcopy() makes sure of. f is the caller's
+// flush set, and va an address in the block.
+static void
+uvmsplit(struct tlbflush *f, uint64 va, pte_t *pte, pagetable_t pt)
+{
+  uint64 pa = PTE2PA(*pte), flags = PTE_FLAGS(*pte);
+
+  ksplit(P2V(pa), HUGEORDER);
+  memset(pt, 0, PGSIZE);
+  for(int i = 0; i < 512; i++){
+    if(pa + i*PGSIZE != V2P(pt))
+      pt[i] = PA2PTE(pa + i*PGSIZE) | flags | PTE_V;
+  }
+
+  // break-before-make: the block becomes a table.
+  *pte = 0;
+  tlbadd(f, va);
+  tlbflush(f);
+  *pte = PA2PTE(V2P(pt)) | PTE_TABLE | PTE_VALID;
+}
+
+// Map a zeroed 2MB block at va, which must be 2MB-aligned,
+// if nothing is mapped in [va, va+2MB) yet and there is a
+// free 2MB block of memory. Returns 0 on success, -1 if not.
+static int
+uvmhuge(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  char *mem;
+
+  pte = walklevel(pagetable, va, 2, 0);
+  if(pte && (*pte & PTE_VALID))
+    return -1;
+  if((mem = kalloc_order(HUGEORDER)) == 0)
+    return -1;
+  memset(mem, 0, HUGESIZE);
+  if(mappages(pagetable, va, HUGESIZE, V2P(mem), PTE_NORMAL|PTE_USER) != 0){
+    kfree_order(mem, HUGEORDER);
+    return -1;
   }
   return 0;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never faulted in (see
+// uvmfault()) are skipped. A 2MB block that is only partly
+// in the range is split into pages first.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  struct tlbflush f;
+  uint64 a, end;
   pte_t *pte;
+  int level;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) != PTE_V)
-      panic("uvmunmap: not mapped");
+  tlbbegin(&f, pagetable);
+  end = va + npages*PGSIZE;
+  for(a = va; a < end; a += PGSIZE){
+    if((pte = walkleaf(pagetable, a, &level)) == 0){
+      // nothing mapped up to the end of the missing table.
+      a = BLKEND(a, level) - PGSIZE;
+      continue;
+    }
     if((*pte & PTE_AF) == 0)
       panic("uvmunmap: not a leaf");
+    if(level != 3){
+      uint64 pa = PTE2PA(*pte);
+      if(a % HUGESIZE == 0 && end - a >= HUGESIZE){
+        if(do_free)
+          kfree_order((void*)P2V(pa), HUGEORDER);
+        *pte = 0;
+        tlbadd(&f, a);
+        a += HUGESIZE - PGSIZE;
+        continue;
+      }
+      // the page at a becomes the new page-table page.
+      if(!do_free)
+        panic("uvmunmap: split");
+      uvmsplit(&f, a, pte, (pagetable_t)P2V(pa + (a % HUGESIZE)));
+      continue;
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)P2V(pa));
     }
     *pte = 0;
+    tlbadd(&f, a);
   }
 
-  flush_tlb();
+  tlbflush(&f);
 }
 
 // create an empty user page table.
@@ -205,10 +455,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -222,10 +471,10 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, V2P(mem), PTE_NORMAL|PTE_USER);
   memmove(mem, src, sz);
+  cpu_sync_cache(mem, PGSIZE);
 }
 
 // Allocate PTEs and physical memory to grow process from oldsz to
@@ -241,12 +490,15 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if(a % HUGESIZE == 0 && newsz - a >= HUGESIZE && uvmhuge(pagetable, a) == 0){
+      a += HUGESIZE - PGSIZE;
+      continue;
+    }
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, V2P(mem), PTE_NORMAL|PTE_USER) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -256,16 +508,167 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
   return newsz;
 }
 
+// Start a flush set for changes to pagetable.
+static void
+tlbbegin(struct tlbflush *f, pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  f->live = p != 0 && p->pagetable == pagetable;
+  f->asid = f->live ? (p->ctxid & ASIDMASK) : 0;
+  f->n = 0;
+}
+
+// Add the page or block at va to flush set f.
+static void
+tlbadd(struct tlbflush *f, uint64 va)
+{
+  if(!f->live || f->n < 0)
+    return;
+  if(f->n == NTLBFLUSH){
+    f->n = -1;
+    return;
+  }
+  f->va[f->n++] = va;
+}
+
+// Invalidate the TLB entries in flush set f on all CPUs,
+// and empty it.
+static void
+tlbflush(struct tlbflush *f)
+{
+  if(f->n < 0){
+    flush_tlb_asid(f->asid);
+  } else if(f->n > 0){
+    dsb(ishst);
+    for(int i = 0; i < f->n; i++)
+      tlbi_vale1is(f->asid, f->va[i]);
+    dsb(ish);
+    isb();
+  }
+  f->n = 0;
+}
+
+// Start a new ASID generation.
+// asid.lock must be held.
+static void
+asidrollover(void)
+{
+  uint64 a, ctxid;
+
+  __atomic_store_n(&asid.gen, asid.gen + (1UL << asid.bits), __ATOMIC_SEQ_CST);
+  memset(asid.map, 0, sizeof(asid.map));
+  asid.map[0] = 1;
+  for(int i = 0; i < NCPU; i++){
+    ctxid = __atomic_exchange_n(&asid.active[i], 0, __ATOMIC_SEQ_CST);
+    // a slot already 0 has not been switched to since the
+    // last rollover: the CPU still runs what it reserved then.
+    if(ctxid == 0)
+      ctxid = asid.reserved[i];
+    asid.reserved[i] = ctxid;
+    if(ctxid == 0)
+      continue;
+    a = ctxid & ASIDMASK;
+    asid.map[a/64] |= 1UL << (a%64);
+  }
+  asid.next = 1;
+  asid.nrollover++;
+  flush_tlb();
+}
+
+// If ctxid is an older generation's ASID that a CPU carried
+// over, move the reservation to this generation and return
+// the new ctxid; otherwise return 0.
+// asid.lock must be held.
+static uint64
+asidreserved(uint64 ctxid)
+{
+  uint64 new = 0;
+
+  if(ctxid == 0)
+    return 0;
+  for(int i = 0; i < NCPU; i++){
+    if(asid.reserved[i] == ctxid){
+      new = asid.gen | (ctxid & ASIDMASK);
+      asid.reserved[i] = new;
+    }
+  }
+  return new;
+}
+
+// Allocate an ASID in the current generation.
+// asid.lock must be held.
+static uint64
+asidalloc(void)
+{
+  uint64 a, n = 1UL << asid.bits;
+
+  for(int pass = 0; ; pass++){
+    for(a = asid.next; a < n; a++){
+      if((asid.map[a/64] & (1UL << (a%64))) == 0){
+        asid.map[a/64] |= 1UL << (a%64);
+        asid.next = a + 1;
+        return asid.gen | a;
+      }
+    }
+    if(pass == 0 && asid.next > 1)
+      asid.next = 1;
+    else
+      asidrollover();
+  }
+}
+
+// Give back ctxid's ASID, flushing its TLB entries
+// so that it can be reused. It must not be running.
+void
+asidfree(uint64 ctxid)
+{
+  uint64 a = ctxid & ASIDMASK;
+
+  acquire(&asid.lock);
+  if(ctxid != 0 && (ctxid & ~ASIDMASK) != asid.gen)
+    ctxid = asidreserved(ctxid);
+  if(ctxid != 0 && (ctxid & ~ASIDMASK) == asid.gen){
+    flush_tlb_asid(a);
+    asid.map[a/64] &= ~(1UL << (a%64));
+  }
+  // an older generation's ASID that was not carried over
+  // was freed, and its entries flushed, by the rollover.
+  release(&asid.lock);
+}
+
+// Switch TTBR0 to p's page table, tagged with p's ASID.
+// Takes a new ASID if p has none in this generation, unless
+// its old one was carried over.
 void
 switchuvm(struct proc *p)
 {
+  uint64 ctxid, old, *active;
+
   if(p == 0)
     panic("switchuvm: no process");
   if(p->pagetable == 0)
     panic("switchuvm: no pagetable");
 
-  uint64 asid = p->ctxid;
-  uint64 ttbr0 = V2P(p->pagetable) | (asid << 48);
+  push_off();
+  active = &asid.active[cpuid()];
+  old = __atomic_load_n(active, __ATOMIC_RELAXED);
+  // without the lock if p's ASID is of this generation and
+  // no rollover has cleared the slot since it was read.
+  if(old == 0 || (p->ctxid & ~ASIDMASK) != __atomic_load_n(&asid.gen, __ATOMIC_RELAXED) ||
+     !__atomic_compare_exchange_n(active, &old, p->ctxid, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)){
+    acquire(&asid.lock);
+    if((p->ctxid & ~ASIDMASK) != asid.gen){
+      if((ctxid = asidreserved(p->ctxid)) == 0)
+        ctxid = asidalloc();
+      p->ctxid = ctxid;
+    }
+    __atomic_store_n(active, p->ctxid, __ATOMIC_SEQ_CST);
+    release(&asid.lock);
+  }
+  pop_off();
+
+  uint64 ttbr0 = V2P(p->pagetable) | ((p->ctxid & ASIDMASK) << 48);
 
   w_ttbr0_el1(ttbr0);
 
@@ -273,11 +676,14 @@ switchuvm(struct proc *p)
   isb();
 }
 
+// Switch TTBR0 to the empty page table.
+// The TLB keeps the last process's entries, under its ASID,
+// which stays in the CPU's active slot.
 void
 switchkvm(void)
 {
-  w_ttbr0_el1(0);
-  flush_tlb();
+  w_ttbr0_el1(V2P(empty_pagetable));
+  isb();
 
   __sync_synchronize();
 }
@@ -315,6 +721,9 @@ freewalk(pagetable_t pagetable)
       uint64 child = PTE2PA(pte);
       freewalk((pagetable_t)P2V(child));
       pagetable[i] = 0;
+    } else if(pte & PTE_VALID){
+      // a page or a block.
+      panic("freewalk: leaf");
     }
   }
   kfree((void*)pagetable);
@@ -331,41 +740,411 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 }
 
 // Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// its memory in [start, end) into a child's page table.
+// User pages are not copied: both page tables share them
+// read-only and marked PTE_COW, and the first write to one
+// that the region allows makes a private copy (see uvmcow()).
+// Pages the parent never touched stay unmapped in both.
+// If shared (a MAP_SHARED region), the pages are shared as
+// they are instead, except for copy-on-write ones.
+// The parent's 2MB blocks are split into pages first, so that
+// no block is ever shared.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
-uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int shared)
 {
+  struct tlbflush f;
   pte_t *pte;
   uint64 pa, i;
   uint64 flags;
   char *mem;
+  int level;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+  tlbbegin(&f, old);
+  for(i = start; i < end; i += PGSIZE){
+    if((pte = walkleaf(old, i, &level)) == 0){
+      // a reserved but untouched hole: skip what the missing
+      // table would have mapped.
+      i = BLKEND(i, level) - PGSIZE;
+      continue;
+    }
+    if(level != 3){
+      if((mem = kalloc()) == 0)
+        goto err;
+      uvmsplit(&f, i, pte, (pagetable_t)mem);
+      pte = walk(old, i, 0);
+    }
     if((*pte & PTE_AF) == 0)
       panic("uvmcopy: page not present");
     pa = PTE2PA(*pte);
+    if(shared && (*pte & PTE_COW) == 0){
+      // both write the same page. the child's mapping starts
+      // clean, so that msync() sees the child's writes too.
+      flags = (PTE_FLAGS(*pte) & ~PTE_DIRTY) | PTE_RO;
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      kincref(P2V(pa));
+      continue;
+    }
+    if((*pte & PTE_U) == 0){
+      // not user-accessible (e.g. the stack guard page);
+      // never faults in, so give the child its own copy.
+      flags = PTE_FLAGS(*pte);
+      if((mem = kalloc()) == 0)
+        goto err;
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+      if(mappages(new, i, PGSIZE, V2P(mem), flags) != 0){
+        kfree(mem);
+        goto err;
+      }
+      continue;
+    }
+    if((*pte & PTE_RO) == 0)
+      tlbadd(&f, i);
+    *pte |= PTE_RO | PTE_COW;
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
+    kincref(P2V(pa));
+  }
+
+  // the parent's writable pages just became read-only.
+  tlbflush(&f);
+  return 0;
+
+ err:
+  tlbflush(&f);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
+  return -1;
+}
+
+// PTE bits for user memory with PROT_ bits prot.
+static uint64
+protflags(int prot)
+{
+  uint64 flags = PTE_NORMAL | PTE_nG;
+
+  if(prot & (PROT_READ | PROT_WRITE | PROT_EXEC))
+    flags |= PTE_U;
+  if((prot & PROT_WRITE) == 0)
+    flags |= PTE_RO;
+  if((prot & PROT_EXEC) == 0)
+    flags |= PTE_UXN;
+  return flags;
+}
+
+// Give the pages mapped in [va, va+npages*PGSIZE) the access
+// permissions of PROT_ bits prot, for mprotect().
+// Copy-on-write pages stay read-only until uvmcow().
+void
+uvmprotect(pagetable_t pagetable, uint64 va, uint64 npages, int prot)
+{
+  struct tlbflush f;
+  uint64 a, perm, flags;
+  pte_t *pte;
+  int level;
+
+  perm = PTE_AP(3) | PTE_UXN;
+  flags = protflags(prot) & perm;
+  tlbbegin(&f, pagetable);
+  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+    if((pte = walkleaf(pagetable, a, &level)) == 0){
+      a = BLKEND(a, level) - PGSIZE;
+      continue;
+    }
+    if(level != 3)
+      panic("uvmprotect: block");
+    *pte = (*pte & ~perm) | flags;
+    if(*pte & PTE_COW)
+      *pte |= PTE_RO;
+    tlbadd(&f, a);
+  }
+  tlbflush(&f);
+}
+
+// Resolve a write to the copy-on-write page at va of
+// pagetable, mapped by pte: copy it to a private page, or
+// just make it writable again if no one else shares it any more.
+// Returns 0 on success, -1 if there is no memory for the copy.
+static int
+uvmcow(pagetable_t pagetable, uint64 va, pte_t *pte)
+{
+  struct tlbflush f;
+  uint64 pa, flags;
+  char *mem;
+
+  tlbbegin(&f, pagetable);
+  pa = PTE2PA(*pte);
+  flags = PTE_FLAGS(*pte) & ~(PTE_RO | PTE_COW);
+
+  if(krefcnt(P2V(pa)) == 1){
+    *pte = PA2PTE(pa) | flags;
+    tlbadd(&f, va);
+    tlbflush(&f);
+    return 0;
+  }
+
+  if(pa == V2P(zeropage))
+    mem = kalloc_zeroed();
+  else
+    mem = kalloc();
+  if(mem == 0)
+    return -1;
+  if(pa != V2P(zeropage)){
     memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(new, i, PGSIZE, V2P(mem), flags) != 0){
-      kfree(mem);
-      goto err;
+    if((flags & PTE_UXN) == 0){
+      // the copy may be of text; make the instructions
+      // visible to instruction fetch.
+      cpu_sync_cache(mem, PGSIZE);
     }
   }
+
+  // break-before-make: the output address changes.
+  *pte = 0;
+  tlbadd(&f, va);
+  tlbflush(&f);
+  *pte = PA2PTE(V2P(mem)) | flags;
+  kfree((void*)P2V(pa));
+
   return 0;
+}
 
- err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+// Map a zero-filled page at va of p, with PTE bits flags.
+// va lies in a part of the heap that growproc() reserved but
+// never allocated, in anonymous mmap() memory, or in the
+// zero-filled end of a file-backed region. A read maps
+// the shared zero page, copy-on-write; only a write needs a
+// page of p's own.
+// Returns 0 on success, -1 if out of memory.
+static int
+uvmlazy(struct proc *p, uint64 va, int write, uint64 flags)
+{
+  char *mem;
+
+  if(!write){
+    if(mappages(p->pagetable, va, PGSIZE, V2P(zeropage),
+                flags|PTE_RO|PTE_COW) != 0)
+      return -1;
+    kincref(zeropage);
+    p->nzero++;
+    return 0;
+  }
+
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+  if(mappages(p->pagetable, va, PGSIZE, V2P(mem), flags) != 0){
+    kfree(mem);
+    return -1;
+  }
+  p->nzfod++;
+  return 0;
+}
+
+// Find the region of p containing va, or 0.
+static struct vma *
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end != 0 && va >= v->start && va < v->end)
+      return v;
+  }
+  return 0;
+}
+
+// Does any region of p overlap [start, end)?
+static int
+vmaoverlap(struct proc *p, uint64 start, uint64 end)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end != 0 && v->start < end && v->end > start)
+      return 1;
+  }
+  return 0;
+}
+
+// Map the page at va of region v, reading its contents from
+// v's file. The part of the page beyond the file data is zero;
+// a page with no file data at all is left to uvmlazy().
+// A page of a MAP_SHARED region is mapped read-only until it
+// is written, so that msync() knows which pages to write back.
+// Reading may sleep, so this must not be called with a
+// spinlock held; uvmprefault() lets copyin/copyout callers
+// that hold one avoid it.
+// Returns 0 on success, -1 on error.
+static int
+uvmfilein(struct proc *p, struct vma *v, uint64 va, int write)
+{
+  uint64 flags;
+  char *mem;
+  uint n;
+
+  if(va - v->start >= v->filesz)
+    return uvmlazy(p, va, write, protflags(v->prot));
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  n = v->filesz - (va - v->start);
+  if(n > PGSIZE)
+    n = PGSIZE;
+  memset(mem + n, 0, PGSIZE - n);
+  if(intr_get() == 0)
+    goto bad;
+  ilock(v->ip);
+  if(readi(v->ip, 0, (uint64)mem, v->off + (va - v->start), n) != n){
+    iunlock(v->ip);
+    goto bad;
+  }
+  iunlock(v->ip);
+  // the page may hold instructions.
+  cpu_sync_cache(mem, PGSIZE);
+  flags = protflags(v->prot);
+  if(v->flags & MAP_SHARED)
+    flags |= write ? PTE_DIRTY : PTE_RO;
+  if(mappages(p->pagetable, va, PGSIZE, V2P(mem), flags) != 0)
+    goto bad;
+
+  p->nfilein++;
+  return 0;
+
+ bad:
+  kfree(mem);
   return -1;
 }
 
+// Handle a fault on user virtual address va of process p:
+// fill in a page that exec(), growproc() or mmap() left to be
+// loaded on demand, give a copy-on-write page that is
+// being written a private copy, or mark a MAP_SHARED file
+// page that is being written dirty.
+// Returns 0 if the faulting access can be retried, -1 if the
+// access is invalid or memory is exhausted.
+int
+uvmfault(struct proc *p, uint64 va, int write)
+{
+  struct tlbflush f;
+  struct vma *v;
+  pte_t *pte;
+  uint64 base;
+  int level;
+
+  if(va >= MAXUVA)
+    return -1;
+  v = vmalookup(p, PGROUNDDOWN(va));
+  if(v == 0 && va >= p->sz)
+    return -1;
+  if(v && (v->prot & (write ? PROT_WRITE : PROT_READ|PROT_EXEC)) == 0)
+    return -1;
+  va = PGROUNDDOWN(va);
+
+  pte = walkleaf(p->pagetable, va, &level);
+  if(pte == 0){
+    if(v && v->ip)
+      return uvmfilein(p, v, va, write);
+    if(v)
+      return uvmlazy(p, va, write, protflags(v->prot));
+    // on a write, fill the whole 2MB around va at once
+    // if it is all anonymous memory.
+    base = va & ~(HUGESIZE-1);
+    if(write && base + HUGESIZE <= p->sz && !vmaoverlap(p, base, base + HUGESIZE) &&
+       uvmhuge(p->pagetable, base) == 0){
+      p->nhuge++;
+      return 0;
+    }
+    return uvmlazy(p, va, write, PTE_NORMAL|PTE_USER);
+  }
+  if(write && level == 3 && (*pte & PTE_U) && (*pte & PTE_COW)){
+    if(uvmcow(p->pagetable, va, pte) < 0)
+      return -1;
+    p->ncow++;
+    return 0;
+  }
+  if(write && level == 3 && v && v->ip && (v->flags & MAP_SHARED) &&
+     (*pte & PTE_U) && (*pte & PTE_RO)){
+    tlbbegin(&f, p->pagetable);
+    *pte = (*pte & ~PTE_RO) | PTE_DIRTY;
+    tlbadd(&f, va);
+    tlbflush(&f);
+    return 0;
+  }
+  return -1;
+}
+
+// If the page at va is dirty (see uvmfault()), make it clean
+// and read-only again, so that the next write is noticed, and
+// return its kernel address for msync() to write back.
+// Returns 0 if the page is clean or not mapped.
+uint64
+uvmclean(pagetable_t pagetable, uint64 va)
+{
+  struct tlbflush f;
+  pte_t *pte;
+  int level;
+
+  pte = walkleaf(pagetable, va, &level);
+  if(pte == 0 || level != 3 || (*pte & PTE_DIRTY) == 0)
+    return 0;
+  tlbbegin(&f, pagetable);
+  *pte = (*pte & ~PTE_DIRTY) | PTE_RO;
+  tlbadd(&f, va);
+  tlbflush(&f);
+  return (uint64)P2V(PTE2PA(*pte));
+}
+
+// Read in the not-yet-loaded file-backed pages of p in
+// [va, va+len), ahead of a copyin/copyout made while holding
+// a lock (pipes, the console, an inode in readi()/writei()),
+// where uvmfilein() cannot or must not sleep.
+// Errors are left for the copy itself to report.
+void
+uvmprefault(struct proc *p, uint64 va, uint64 len)
+{
+  struct vma *v;
+  uint64 a, end;
+
+  end = va + len;
+  if(end < va || end > MAXUVA)
+    end = MAXUVA;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0 || v->end <= va || v->start >= end)
+      continue;
+    a = PGROUNDDOWN(va > v->start ? va : v->start);
+    for(; a < end && a < v->end; a += PGSIZE){
+      if(walkaddr(p->pagetable, a) == 0){
+        if(uvmfilein(p, v, a, 0) < 0)
+          return;
+      }
+    }
+  }
+}
+
+// Return the kernel address of user page va0 for the kernel
+// to read or write, first faulting it in the way usertrap()
+// would if it belongs to the current process.
+// Returns 0 if va0 is not accessible.
+static uint64
+uvmtouch(pagetable_t pagetable, uint64 va0, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  int level;
+
+  if(va0 >= MAXUVA)
+    return 0;
+  pte = walkleaf(pagetable, va0, &level);
+  if(pte == 0 || (write && (*pte & PTE_RO))){
+    if(p == 0 || p->pagetable != pagetable)
+      return 0;
+    if(uvmfault(p, va0, write) < 0)
+      return 0;
+  }
+  return uva2ka(pagetable, va0);
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -379,17 +1158,55 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// in usercopy.S: copies that use the current process's page
+// table through TTBR0. They return the number of bytes left
+// when a user access faults, and store the faulting address
+// in *fault.
+extern uint64 ucopyout(uint64 dstva, char *src, uint64 len, uint64 *fault);
+extern uint64 ucopyin(char *dst, uint64 srcva, uint64 len, uint64 *fault);
+extern uint64 ucopyinstr(char *dst, uint64 srcva, uint64 max, uint64 *fault);
+
+// If pagetable is the current process's, and so is what TTBR0
+// maps, return the process; the usercopy.S routines can reach
+// its memory directly. Otherwise (exec()'s new image, kernel
+// processes) the copies walk the page table.
+static struct proc*
+ucurrent(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p != 0 && p->pagetable == pagetable)
+    return p;
+  return 0;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
-  uint64 n, va0, pa0;
+  uint64 n, va0, pa0, left, far;
+  struct proc *p;
+
+  if((p = ucurrent(pagetable)) != 0){
+    if(dstva >= MAXUVA || len > MAXUVA - dstva)
+      return -1;
+    // on a fault, fill in the page as usertrap() would
+    // and carry on from where the copy stopped.
+    while((left = ucopyout(dstva, src, len, &far)) != 0){
+      if(uvmfault(p, far, 1) < 0)
+        return -1;
+      dstva += len - left;
+      src += len - left;
+      len = left;
+    }
+    return 0;
+  }
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = uva2ka(pagetable, va0);
+    pa0 = uvmtouch(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -410,11 +1227,25 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  uint64 n, va0, pa0;
+  uint64 n, va0, pa0, left, far;
+  struct proc *p;
+
+  if((p = ucurrent(pagetable)) != 0){
+    if(srcva >= MAXUVA || len > MAXUVA - srcva)
+      return -1;
+    while((left = ucopyin(dst, srcva, len, &far)) != 0){
+      if(uvmfault(p, far, 0) < 0)
+        return -1;
+      dst += len - left;
+      srcva += len - left;
+      len = left;
+    }
+    return 0;
+  }
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = uva2ka(pagetable, va0);
+    pa0 = uvmtouch(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -436,12 +1267,28 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
+  uint64 n, va0, pa0, left, far;
   int got_null = 0;
+  struct proc *p;
+
+  if((p = ucurrent(pagetable)) != 0){
+    if(srcva >= MAXUVA)
+      return -1;
+    if(max > MAXUVA - srcva)
+      max = MAXUVA - srcva;
+    while((left = ucopyinstr(dst, srcva, max, &far)) != 0){
+      if(left == (uint64)-1 || uvmfault(p, far, 0) < 0)
+        return -1;
+      dst += max - left;
+      srcva += max - left;
+      max = left;
+    }
+    return 0;
+  }
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = uva2ka(pagetable, va0);
+    pa0 = uvmtouch(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -0,0 +1,61 @@
+// Run a command and report how long its processes, and any
+// others, waited to run once they were runnable.
+// -t sets the clock tick and -s the time slice of new
+// processes, in microseconds, while it runs.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+void
+usage(void)
+{
+  fprintf(2, "usage: schedlat [-t tickus] [-s sliceus] command [arg...]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedlat sl;
+  int i, pid, tick = 0, slice = 0, otick = 0, oslice = 0;
+
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-t") == 0)
+      tick = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-s") == 0)
+      slice = atoi(argv[i+1]);
+    else
+      usage();
+  }
+  if(i >= argc)
+    usage();
+
+  if(tick && (otick = schedctl(SCHED_TICK, tick)) < 0){
+    fprintf(2, "schedlat: bad tick %d\n", tick);
+    exit(1);
+  }
+  if(slice && (oslice = schedctl(SCHED_DEFSLICE, slice)) < 0){
+    fprintf(2, "schedlat: bad time slice %d\n", slice);
+    exit(1);
+  }
+
+  schedctl(SCHED_LATSTART, 0);
+  if((pid = spawn(argv[i], argv + i, 0)) < 0)
+    fprintf(2, "schedlat: cannot run %s\n", argv[i]);
+  else
+    wait(0);
+  schedctl(SCHED_LATSTOP, 0);
+  schedctl(SCHED_LATREAD, (uint64)&sl);
+
+  printf("tick %dus, slice %dus: %l switches, latency p50 %lus p90 %lus p99 %lus p99.9 %lus max %lus\n",
+         schedctl(SCHED_TICK, 0), schedctl(SCHED_DEFSLICE, 0),
+         sl.n, sl.p50, sl.p90, sl.p99, sl.p999, sl.max);
+
+  if(otick)
+    schedctl(SCHED_TICK, otick);
+  if(oslice)
+    schedctl(SCHED_DEFSLICE, oslice);
+  exit(pid < 0);
+}
@@ -2,9 +2,15 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "kernel/fcntl.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
+//
+// Blocks of MMAPMIN bytes or more get an mmap() region of
+// their own instead, which free() gives back with munmap().
+
+#define MMAPMIN (64*1024)
 
 typedef long Align;
 
@@ -21,12 +27,20 @@ typedef union header Header;
 static Header base;
 static Header *freep;
 
+// s.ptr of a block from mmap(); blocks in use from the
+// free list have s.ptr zero.
+#define MMAPPED ((Header*)1)
+
 void
 free(void *ap)
 {
   Header *bp, *p;
 
   bp = (Header*)ap - 1;
+  if(bp->s.ptr == MMAPPED){
+    munmap(bp, bp->s.size * sizeof(Header));
+    return;
+  }
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -55,6 +69,7 @@ morecore(uint nu)
   if(p == (char*)-1)
     return 0;
   hp = (Header*)p;
+  hp->s.ptr = 0;  // not MMAPPED, whatever sbrk'd memory held
   hp->s.size = nu;
   free((void*)(hp + 1));
   return freep;
@@ -67,6 +82,14 @@ malloc(uint nbytes)
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if(nbytes >= MMAPMIN){
+    p = mmap(0, nunits * sizeof(Header), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+      return 0;
+    p->s.ptr = MMAPPED;
+    p->s.size = nunits;
+    return (void*)(p + 1);
+  }
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -80,6 +103,7 @@ malloc(uint nbytes)
         p += p->s.size;
         p->s.size = nunits;
       }
+      p->s.ptr = 0;
       freep = prevp;
       return (void*)(p + 1);
     }
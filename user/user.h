@@ -1,5 +1,6 @@
 struct stat;
 struct rtcdate;
+struct timespec;
 
 // system calls
 int fork(void);
@@ -23,6 +24,14 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+void* mmap(void*, uint64, int, int, int, uint64);
+int munmap(void*, uint64);
+int mprotect(void*, uint64, int);
+int msync(void*, uint64, int);
+int spawn(char*, char**, int*);
+int nanosleep(const struct timespec*, struct timespec*);
+int clock_gettime(int, struct timespec*);
+int schedctl(int, uint64);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -4,6 +4,8 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/date.h"
+#include "kernel/sched.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/aarch64.h"
@@ -232,6 +234,63 @@ copyinstr3(char *s)
   }
 }
 
+// do copies to and from user memory at odd alignments, across
+// page boundaries, into pages not yet touched, get every byte?
+void
+copyodd(char *s)
+{
+  enum { SZ = 4*PGSIZE, N = 2*PGSIZE + 13 };
+  char *a, *name;
+  int fd, i, n;
+
+  a = sbrk(SZ);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    a[3 + i] = i % 251;
+
+  fd = open("copyodd", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if(write(fd, a + 3, N) != N){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // read it back at another alignment, partly into the
+  // untouched last page.
+  fd = open("copyodd", O_RDONLY);
+  n = read(fd, a + SZ - N, N);
+  close(fd);
+  if(n != N){
+    printf("%s: read returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(a[SZ - N + i] != (char)(i % 251)){
+      printf("%s: wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  // a path name that straddles two pages.
+  name = a + 2*PGSIZE - 4;
+  strcpy(name, "copyodd");
+  fd = open(name, O_RDONLY);
+  if(fd < 0){
+    printf("%s: open of straddling name failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("copyodd");
+  sbrk(-SZ);
+}
+
 // See if the kernel refuses to read/write user memory that the
 // application doesn't have anymore, because it returned it.
 void
@@ -727,6 +786,53 @@ exectest(char *s)
 
 }
 
+// spawn() a program with its output in a pipe.
+void
+spawntest(char *s)
+{
+  char *echoargv[] = { "echo", "spawned", 0 };
+  char *nope[] = { "nosuchprogram", 0 };
+  int fds[2], cfd[3], pid, xstatus, n, tot;
+  char buf[16];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  cfd[0] = -1;
+  cfd[1] = fds[1];
+  cfd[2] = 2;
+  if(spawn("nosuchprogram", nope, cfd) >= 0){
+    printf("%s: spawn of a missing program succeeded\n", s);
+    exit(1);
+  }
+  cfd[0] = NOFILE - 1;
+  if(spawn("echo", echoargv, cfd) >= 0){
+    printf("%s: spawn with a closed fd succeeded\n", s);
+    exit(1);
+  }
+  cfd[0] = -1;
+  if((pid = spawn("echo", echoargv, cfd)) < 0){
+    printf("%s: spawn echo failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  // EOF only once echo exits: it has no other copy of fds[1].
+  tot = 0;
+  while((n = read(fds[0], buf + tot, sizeof(buf) - 1 - tot)) > 0)
+    tot += n;
+  close(fds[0]);
+  buf[tot] = 0;
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait for spawned child failed\n", s);
+    exit(1);
+  }
+  if(strcmp(buf, "spawned\n") != 0){
+    printf("%s: wrong output %s\n", s, buf);
+    exit(1);
+  }
+}
+
 // simple fork and pipe read/write
 
 void
@@ -812,6 +918,143 @@ killstatus(char *s)
   exit(0);
 }
 
+static uint64
+nsec(struct timespec *ts)
+{
+  return ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+// nanosleep() sleeps for at least as long as asked, but is
+// not rounded up to clock ticks; a kill ends it early.
+void
+nanosleeptest(char *s)
+{
+  struct timespec t0, t1, req;
+  int i, pid, xst;
+
+  req.tv_sec = 0;
+  req.tv_nsec = 1000000000;
+  if(nanosleep(&req, 0) != -1){
+    printf("%s: nanosleep accepted tv_nsec 1000000000\n", s);
+    exit(1);
+  }
+  if(clock_gettime(0, &t0) != -1){
+    printf("%s: clock_gettime accepted clock 0\n", s);
+    exit(1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  req.tv_nsec = 20000000;
+  if(nanosleep(&req, 0) < 0){
+    printf("%s: nanosleep failed\n", s);
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if(nsec(&t1) - nsec(&t0) < 20000000){
+    printf("%s: nanosleep(20ms) returned after %d us\n", s,
+           (int)((nsec(&t1) - nsec(&t0)) / 1000));
+    exit(1);
+  }
+
+  // ten 1ms sleeps take about 10ms; a clock tick is 100ms.
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  req.tv_nsec = 1000000;
+  for(i = 0; i < 10; i++)
+    nanosleep(&req, 0);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if(nsec(&t1) - nsec(&t0) >= 500000000){
+    printf("%s: 10 nanosleep(1ms) took %d us\n", s,
+           (int)((nsec(&t1) - nsec(&t0)) / 1000));
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    req.tv_sec = 100;
+    req.tv_nsec = 0;
+    nanosleep(&req, 0);
+    exit(0);
+  }
+  sleep(1);
+  kill(pid);
+  wait(&xst);
+  if(xst != -1){
+    printf("%s: killed nanosleep() status %d\n", s, xst);
+    exit(1);
+  }
+  exit(0);
+}
+
+// the tick and time slices can be changed while running,
+// and scheduling latency measured.
+void
+schedtune(char *s)
+{
+  struct timespec t0, t1;
+  struct schedlat sl;
+  int tick, slice, i, pid;
+
+  tick = schedctl(SCHED_TICK, 0);
+  if(tick <= 0 || schedctl(SCHED_TICK, 10) != -1 || schedctl(99, 0) != -1){
+    printf("%s: schedctl accepted bad arguments\n", s);
+    exit(1);
+  }
+  // with a 10ms tick, sleep(5) lasts 50ms.
+  if(schedctl(SCHED_TICK, 10000) != tick){
+    printf("%s: SCHED_TICK failed\n", s);
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  sleep(5);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  schedctl(SCHED_TICK, tick);
+  if(nsec(&t1) - nsec(&t0) < 50000000 || nsec(&t1) - nsec(&t0) >= 400000000){
+    printf("%s: sleep(5) with a 10ms tick took %d us\n", s,
+           (int)((nsec(&t1) - nsec(&t0)) / 1000));
+    exit(1);
+  }
+
+  slice = schedctl(SCHED_SLICE, 1000);
+  if(slice <= 0 || schedctl(SCHED_SLICE, 0) != 1000){
+    printf("%s: SCHED_SLICE failed\n", s);
+    exit(1);
+  }
+
+  // runnable processes wait, and are measured.
+  schedctl(SCHED_LATSTART, 0);
+  for(i = 0; i < 8; i++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      do {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+      } while(nsec(&t1) - nsec(&t0) < 50000000);
+      exit(0);
+    }
+  }
+  for(i = 0; i < 8; i++)
+    wait(0);
+  schedctl(SCHED_LATSTOP, 0);
+  if(schedctl(SCHED_LATREAD, (uint64)&sl) < 0){
+    printf("%s: SCHED_LATREAD failed\n", s);
+    exit(1);
+  }
+  if(sl.n < 8 || sl.p50 > sl.p90 || sl.p90 > sl.p99 || sl.p99 > sl.p999 ||
+     sl.p999 > sl.max + sl.max/8){
+    printf("%s: bad latencies n %d p50 %d p90 %d p99 %d p99.9 %d max %d\n", s,
+           (int)sl.n, (int)sl.p50, (int)sl.p90, (int)sl.p99, (int)sl.p999, (int)sl.max);
+    exit(1);
+  }
+  exit(0);
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -2083,6 +2326,433 @@ forktest(char *s)
   }
 }
 
+// fork shares memory copy-on-write; do writes by the child,
+// directly and through read(), stay invisible to the parent?
+void
+cowfork(char *s)
+{
+  enum { SZ = 64*PGSIZE };
+  int fds[2], pid, xstatus;
+  char *a;
+
+  a = sbrk(SZ);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < SZ; i += PGSIZE)
+    a[i] = 'p';
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < SZ; i += 2*PGSIZE)
+      a[i] = 'c';
+    write(fds[1], "cc", 2);
+    if(read(fds[0], a + PGSIZE, 2) != 2){
+      printf("%s: read into shared page failed\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < SZ; i += PGSIZE){
+      char want = ((i / PGSIZE) % 2 == 0 || i == PGSIZE) ? 'c' : 'p';
+      if(a[i] != want){
+        printf("%s: child sees wrong data at %d\n", s, i);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  for(int i = 0; i < SZ; i += PGSIZE){
+    if(a[i] != 'p'){
+      printf("%s: child write leaked into parent at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// do FP/SIMD registers survive sleeping, other processes
+// using them on the same CPU, moving between CPUs, and fork()?
+void
+fpregs(char *s)
+{
+  enum { NCHILD = 8, N = 1000000 };
+  volatile double seed = 0.5;
+  double x, sum;
+  int i, k, pid, xst;
+
+  x = seed * 3;
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      sum = 0;
+      for(k = 0; k < N; k++){
+        sum += x + i;
+        if(k % (N/8) == 0)
+          sleep(1);
+      }
+      exit(sum == (x + i) * N ? 0 : 1);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xst);
+    if(xst != 0){
+      printf("%s: wrong FP result\n", s);
+      exit(1);
+    }
+  }
+}
+
+// does a child that reads (or writes) *a get killed?
+static int
+touchkills(volatile char *a, int write)
+{
+  int pid, xst;
+
+  pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(write)
+      *a = 1;
+    else
+      xst = *a;
+    exit(0);
+  }
+  wait(&xst);
+  return xst == -1;
+}
+
+// mmap(), munmap() and mprotect() of anonymous memory,
+// and malloc() giving big blocks back.
+void
+mmapanon(char *s)
+{
+  enum { N = 16, BIG = 1024*1024 };
+  char *a, *b;
+  int i, pid, xst;
+
+  a = mmap(0, N*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(a[i*PGSIZE] != 0){
+      printf("%s: fresh mmap memory not zero\n", s);
+      exit(1);
+    }
+    a[i*PGSIZE] = i;
+  }
+
+  // private: a child's writes stay in the child.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++)
+      if(a[i*PGSIZE] != i)
+        exit(1);
+    a[0] = 99;
+    exit(0);
+  }
+  wait(&xst);
+  if(xst != 0 || a[0] != 0){
+    printf("%s: fork of mmap memory\n", s);
+    exit(1);
+  }
+
+  // a hole in the middle.
+  if(munmap(a + 4*PGSIZE, 2*PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(!touchkills(a + 5*PGSIZE, 0) || a[3*PGSIZE] != 3 || a[6*PGSIZE] != 6){
+    printf("%s: munmap of a hole\n", s);
+    exit(1);
+  }
+
+  // a read-only page, and back.
+  if(mprotect(a + 8*PGSIZE, PGSIZE, PROT_READ) < 0){
+    printf("%s: mprotect failed\n", s);
+    exit(1);
+  }
+  if(a[8*PGSIZE] != 8 || !touchkills(a + 8*PGSIZE, 1)){
+    printf("%s: mprotect PROT_READ\n", s);
+    exit(1);
+  }
+  if(mprotect(a + 8*PGSIZE, PGSIZE, PROT_READ|PROT_WRITE) < 0){
+    printf("%s: mprotect failed\n", s);
+    exit(1);
+  }
+  a[8*PGSIZE] = 'x';
+
+  // fill the hole again.
+  b = mmap(a + 4*PGSIZE, PGSIZE, PROT_READ|PROT_WRITE,
+           MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0);
+  if(b != a + 4*PGSIZE || b[0] != 0){
+    printf("%s: mmap MAP_FIXED\n", s);
+    exit(1);
+  }
+  if(munmap(a, N*PGSIZE) < 0 || !touchkills(a + 8*PGSIZE, 0)){
+    printf("%s: munmap of everything\n", s);
+    exit(1);
+  }
+
+  // big blocks from malloc() go back on free().
+  if((b = malloc(BIG)) == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+  b[0] = b[BIG-1] = 1;
+  free(b);
+  if(!touchkills(b + BIG/2, 0)){
+    printf("%s: freed block still mapped\n", s);
+    exit(1);
+  }
+}
+
+// mmap() of a file, private and shared, and msync().
+void
+mmapfile(char *s)
+{
+  enum { SZ = 2*PGSIZE + 100 };
+  static char buf[SZ];
+  char *a, *b;
+  int fd, i, pid, xst, fds[2];
+
+  for(i = 0; i < SZ; i++)
+    buf[i] = 'a' + i % 23;
+  fd = open("mmapfile", O_CREATE|O_WRONLY);
+  if(fd < 0 || write(fd, buf, SZ) != SZ){
+    printf("%s: create mmapfile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // private, from a read-only file.
+  fd = open("mmapfile", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open mmapfile failed\n", s);
+    exit(1);
+  }
+  if(mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED){
+    printf("%s: writable MAP_SHARED of a read-only file\n", s);
+    exit(1);
+  }
+  a = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  b = mmap(0, SZ, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(a == MAP_FAILED || b == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  // the kernel reads the last page straight from the mapping.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], b + 2*PGSIZE, 100) != 100 || read(fds[0], buf, 100) != 100 ||
+     memcmp(buf, b + 2*PGSIZE, 100) != 0){
+    printf("%s: write() from a mapped file\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < SZ; i++){
+    if(a[i] != 'a' + i % 23 || b[i] != a[i]){
+      printf("%s: wrong contents at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(a[SZ] != 0 || a[3*PGSIZE-1] != 0){
+    printf("%s: past the end of the file not zero\n", s);
+    exit(1);
+  }
+  if(mprotect(b, PGSIZE, PROT_READ|PROT_WRITE) == 0){
+    printf("%s: mprotect made a read-only file writable\n", s);
+    exit(1);
+  }
+  a[0] = 'X';
+  if(b[0] != 'a' || munmap(a, SZ) < 0 || munmap(b, SZ) < 0){
+    printf("%s: MAP_PRIVATE write\n", s);
+    exit(1);
+  }
+
+  // shared: writes reach the file, from a child too.
+  fd = open("mmapfile", O_RDWR);
+  if(fd < 0){
+    printf("%s: open mmapfile failed\n", s);
+    exit(1);
+  }
+  a = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: mmap MAP_SHARED failed\n", s);
+    exit(1);
+  }
+  a[0] = 'X';
+  a[PGSIZE+5] = 'Y';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[1] = 'Z';
+    exit(0);
+  }
+  wait(&xst);
+  if(xst != 0 || a[1] != 'Z'){
+    printf("%s: fork of MAP_SHARED memory\n", s);
+    exit(1);
+  }
+  if(msync(a, SZ, MS_SYNC) < 0){
+    printf("%s: msync failed\n", s);
+    exit(1);
+  }
+  if(read(fd, buf, SZ) != SZ || buf[0] != 'X' || buf[1] != 'Z' || buf[PGSIZE+5] != 'Y'){
+    printf("%s: msync did not write the file\n", s);
+    exit(1);
+  }
+  // munmap() writes back too.
+  a[SZ-1] = 'W';
+  if(munmap(a, SZ) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(read(fd, buf, 1) != 0){
+    printf("%s: MAP_SHARED grew the file\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(fd < 0 || read(fd, buf, SZ) != SZ || buf[SZ-1] != 'W' || buf[2] != 'a' + 2){
+    printf("%s: munmap did not write the file\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+}
+
+// a large heap gets 2MB blocks; do shrinking into the middle
+// of one, and fork (which splits them), keep the data intact?
+void
+hugeheap(char *s)
+{
+  enum { HUGE = 2*1024*1024, SZ = 4*HUGE };
+  uint64 top;
+  int pid, xstatus;
+  char *a, *p;
+
+  // start on a 2MB boundary so that whole blocks fit.
+  top = (uint64)sbrk(0);
+  a = (char*)((top + HUGE - 1) & ~(uint64)(HUGE - 1));
+  if(sbrk(a - (char*)top + SZ) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + SZ; p += PGSIZE)
+    *(int*)p = p - a;
+
+  // cut the last block in half.
+  if(sbrk(-HUGE/2) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + SZ - HUGE/2; p += PGSIZE){
+    if(*(int*)p != p - a){
+      printf("%s: wrong data after shrink at %p\n", s, p);
+      exit(1);
+    }
+  }
+  // the freed half must come back zeroed.
+  sbrk(HUGE/2);
+  for(p = a + SZ - HUGE/2; p < a + SZ; p += PGSIZE){
+    if(*(int*)p != 0){
+      printf("%s: regrown memory not zero at %p\n", s, p);
+      exit(1);
+    }
+    *(int*)p = p - a;
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < a + SZ; p += PGSIZE){
+      if(*(int*)p != p - a){
+        printf("%s: child sees wrong data at %p\n", s, p);
+        exit(1);
+      }
+      *(int*)p = -1;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  for(p = a; p < a + SZ; p += PGSIZE){
+    if(*(int*)p != p - a){
+      printf("%s: child write leaked into parent at %p\n", s, p);
+      exit(1);
+    }
+  }
+  sbrk(-(sbrk(0) - (char*)top));
+}
+
+// untouched memory that is only read shares one zero page;
+// does writing one such page leave the others zero?
+void
+zeroread(char *s)
+{
+  enum { SZ = 64*PGSIZE };
+  char *a;
+  int i, n;
+
+  a = sbrk(SZ);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  n = 0;
+  for(i = 0; i < SZ; i += PGSIZE)
+    n += a[i] + a[i + PGSIZE - 1];
+  if(n != 0){
+    printf("%s: fresh memory not zero\n", s);
+    exit(1);
+  }
+  a[5*PGSIZE] = 'x';
+  for(i = 0; i < SZ; i++){
+    if(a[i] != (i == 5*PGSIZE ? 'x' : 0)){
+      printf("%s: wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+  sbrk(-SZ);
+}
+
 void
 sbrkbasic(char *s)
 {
@@ -2307,11 +2977,13 @@ sbrkfail(char *s)
   if(pid == 0){
     // allocate a lot of memory.
     // this should produce a page fault,
-    // and thus not complete.
+    // and thus not complete. (write: reads
+    // would all share the zero page.)
     a = sbrk(0);
     sbrk(10*BIG);
     int n = 0;
     for (i = 0; i < 10*BIG; i += PGSIZE) {
+      *(a+i) = 1;
       n += *(a+i);
     }
     // print n so the compiler doesn't optimize away
@@ -2829,6 +3501,7 @@ main(int argc, char *argv[])
     {copyinstr1, "copyinstr1"},
     {copyinstr2, "copyinstr2"},
     {copyinstr3, "copyinstr3"},
+    {copyodd, "copyodd"},
     {rwsbrk, "rwsbrk" },
     {truncate1, "truncate1"},
     {truncate2, "truncate2"},
@@ -2853,6 +3526,7 @@ main(int argc, char *argv[])
     {sharedfd, "sharedfd"},
     {dirtest, "dirtest"},
     {exectest, "exectest"},
+    {spawntest, "spawntest"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
@@ -2875,6 +3549,8 @@ main(int argc, char *argv[])
     {mem, "mem"},
     {pipe1, "pipe1"},
     {killstatus, "killstatus"},
+    {nanosleeptest, "nanosleeptest"},
+    {schedtune, "schedtune"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -2883,6 +3559,12 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {cowfork, "cowfork"},
+    {hugeheap, "hugeheap"},
+    {zeroread, "zeroread"},
+    {fpregs, "fpregs"},
+    {mmapanon, "mmapanon"},
+    {mmapfile, "mmapfile"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
@@ -36,3 +36,11 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("mmap");
+entry("munmap");
+entry("mprotect");
+entry("msync");
+entry("spawn");
+entry("nanosleep");
+entry("clock_gettime");
+entry("schedctl");